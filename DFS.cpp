@@ -3,119 +3,1885 @@
 #include <fstream>
 #include <sstream>
 #include <algorithm>
-#include <cmath>  // 用於 pow()
+#include <cmath>
+#include <array>
+#include <cstdint>
 #include <chrono> //timer
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <deque>
+#include <random>
+#include <filesystem>
+#include <memory>
+#include <cstdio>  // rename(), remove()
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace std;
 
-// 讀檔
-vector<vector<int>> readCSV(const string &filename, int &D) {
-    ifstream file(filename);
-    vector<vector<int>> clauses;
-    string line;
+// 壓縮子句：所有 literal 放在同一個平坦陣列，變數與正負號分在不同位元欄位
+// lit = (var << 1) | 負號，子句 i 為 lits[start[i]] ~ lits[start[i+1] - 1]
+struct PackedClauses {
+    vector<uint32_t> lits;
+    vector<uint32_t> start{0};
 
-    while (getline(file, line)) {
-        vector<int> clause;
-        stringstream ss(line);
-        string token;
+    size_t size() const { return start.size() - 1; }
+    const uint32_t *begin(size_t c) const { return lits.data() + start[c]; }
+    const uint32_t *end(size_t c) const { return lits.data() + start[c + 1]; }
 
-        while (getline(ss, token, ',')) { 
-            token.erase(remove(token.begin(), token.end(), ' '), token.end());  //Delete Space
-            if (token[0] == '+') token = token.substr(1);       //Delete + char.
-            clause.push_back(stoi(token));
+    void add_literal(int literal) { lits.push_back((uint32_t)(abs(literal) - 1) << 1 | (literal < 0)); }
+    void end_clause() { start.push_back(lits.size()); }
+};
+
+// 唯讀 mmap 整個檔案，離開範圍時自動 munmap
+struct MappedFile {
+    const char *data = nullptr;
+    size_t size = 0;
+    struct stat info {};
+
+    explicit MappedFile(const string &filename) {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        if (fstat(fd, &info) == 0 && info.st_size > 0) {
+            void *p = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                data = (const char *)p;
+                size = info.st_size;
+            }
         }
+        close(fd);
+    }
+    ~MappedFile() {
+        if (data) munmap((void *)data, size);
+    }
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+};
+
+// 二進位快取的檔頭，後面接著 start[] 與 lits[] 兩個 uint32_t 陣列
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t D;
+    uint64_t num_clauses;
+    uint64_t num_lits;
+    int64_t source_size;   // 原始檔的大小與修改時間，不符就表示快取已過期
+    int64_t source_mtime;  // 奈秒
+};
+const char CACHE_MAGIC[8] = "3SATBIN";
+const uint32_t CACHE_VERSION = 1;
 
-        clauses.push_back(clause);
+// 讀取數字 (可帶 + / - 號)，p 會移到數字之後
+inline int parse_int(const char *&p, const char *end) {
+    bool neg = false;
+    if (p < end && (*p == '+' || *p == '-')) neg = (*p++ == '-');
+    int x = 0;
+    while (p < end && *p >= '0' && *p <= '9') x = x * 10 + (*p++ - '0');
+    return neg ? -x : x;
+}
+
+// 原本的 3SAT_Dim=N.csv：每行一個子句，literal 以逗號分隔，可有空白與 + 號
+void parseCSV(const char *p, const char *end, PackedClauses &clauses, int &D) {
+    while (p < end) {
+        bool any = false;
+        while (p < end && *p != '\n') {
+            if (*p == '+' || *p == '-' || (*p >= '0' && *p <= '9')) {
+                int literal = parse_int(p, end);
+                if (literal == 0) continue;
+                clauses.add_literal(literal);
+                D = max(D, abs(literal));
+                any = true;
+            } else {
+                p++;  // 逗號、空白、\r
+            }
+        }
+        if (any) clauses.end_clause();
+        p++;
     }
+}
 
-    file.close();
-    D = 0;
-    for (const auto &clause : clauses) {
-        for (int lit : clause) {
-            D = max(D, abs(lit)); 
+// DIMACS CNF：c 開頭為註解，p cnf <變數數> <子句數>，literal 以空白分隔，0 結束一個子句
+// 不是整數的 token (例如 x、單獨的 -、12abc) 連同該行其餘部分一起跳過並計數，不會結束子句；沒有開著的子句時 0 也不算
+void parseDIMACS(const char *p, const char *end, PackedClauses &clauses, int &D) {
+    bool open_clause = false;
+    long long skipped = 0;
+    while (p < end) {
+        char c = *p;
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+            p++;
+        } else if (c == 'c' || c == 'p') {
+            if (c == 'p') {  // 檔頭：變數數量可能比實際出現的多
+                const char *q = p + 1;
+                while (q < end && (*q == ' ' || *q == '\t')) q++;
+                if (end - q >= 3 && string(q, 3) == "cnf") {
+                    q += 3;
+                    while (q < end && (*q == ' ' || *q == '\t')) q++;
+                    D = max(D, parse_int(q, end));
+                    while (q < end && (*q == ' ' || *q == '\t')) q++;
+                    int num_clauses = parse_int(q, end);
+                    clauses.start.reserve(num_clauses + 1);
+                    clauses.lits.reserve((size_t)num_clauses * 3);
+                }
+            }
+            while (p < end && *p != '\n') p++;
+        } else if (c == '%') {  // SATLIB 檔案的結尾標記
+            break;
+        } else {
+            const char *token = p;
+            int literal = parse_int(p, end);
+            bool digits = p > token && p[-1] >= '0' && p[-1] <= '9';
+            bool delimited = p == end || *p == ' ' || *p == '\t' || *p == '\r' || *p == '\n';
+            if (!digits || !delimited) {
+                skipped++;
+                while (p < end && *p != '\n') p++;  // 不認得的內容就跳過整行
+            } else if (literal == 0) {
+                if (open_clause) clauses.end_clause();
+                open_clause = false;
+            } else {
+                clauses.add_literal(literal);
+                D = max(D, abs(literal));
+                open_clause = true;
+            }
         }
     }
+    if (open_clause) clauses.end_clause();  // 最後一個子句沒有 0 結尾
+    if (skipped) cerr << "Warning: skipped " << skipped << " unrecognised DIMACS token(s) and the rest of their lines" << endl;
+}
+
+inline int64_t mtime_ns(const struct stat &st) { return (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec; }
+
+bool loadCache(const string &cachename, const struct stat &source, PackedClauses &clauses, int &D) {
+    MappedFile cache(cachename);
+    if (!cache.data || cache.size < sizeof(CacheHeader)) return false;
 
+    CacheHeader h;
+    memcpy(&h, cache.data, sizeof h);
+    if (memcmp(h.magic, CACHE_MAGIC, sizeof h.magic) != 0 || h.version != CACHE_VERSION) return false;
+    if (h.source_size != (int64_t)source.st_size || h.source_mtime != mtime_ns(source)) return false;
+    if (cache.size != sizeof h + (h.num_clauses + 1 + h.num_lits) * sizeof(uint32_t)) return false;
+
+    const uint32_t *start = (const uint32_t *)(cache.data + sizeof h);
+    const uint32_t *lits = start + h.num_clauses + 1;
+
+    // 內容也要檢查：start[] 從 0 遞增到 num_lits，literal 的變數編號小於 D，否則當作壞掉的快取重新解析
+    if (start[0] != 0 || start[h.num_clauses] != h.num_lits) return false;
+    for (size_t c = 0; c < h.num_clauses; ++c)
+        if (start[c] > start[c + 1]) return false;
+    for (size_t i = 0; i < h.num_lits; ++i)
+        if ((lits[i] >> 1) >= h.D) return false;
+
+    clauses.start.assign(start, start + h.num_clauses + 1);
+    clauses.lits.assign(lits, lits + h.num_lits);
+    D = h.D;
+    return true;
+}
+
+// 快取先寫到暫存檔再改名；寫不進去 (例如唯讀目錄) 就算了，下次再解析一次
+void saveCache(const string &cachename, const struct stat &source, const PackedClauses &clauses, int D) {
+    CacheHeader h{};
+    memcpy(h.magic, CACHE_MAGIC, sizeof h.magic);
+    h.version = CACHE_VERSION;
+    h.D = D;
+    h.num_clauses = clauses.size();
+    h.num_lits = clauses.lits.size();
+    h.source_size = source.st_size;
+    h.source_mtime = mtime_ns(source);
+
+    string tmp = cachename + ".tmp";
+    ofstream out(tmp, ios::binary);
+    out.write((const char *)&h, sizeof h);
+    out.write((const char *)clauses.start.data(), clauses.start.size() * sizeof(uint32_t));
+    out.write((const char *)clauses.lits.data(), clauses.lits.size() * sizeof(uint32_t));
+    out.close();
+    if (!out || rename(tmp.c_str(), cachename.c_str()) != 0) remove(tmp.c_str());
+}
+
+// 讀檔：mmap 後單次掃描，literal 直接寫進平坦的子句陣列，同時算出變數數量 D
+// .cnf 結尾當作 DIMACS，其他當作原本的 CSV 格式；use_cache 時讀寫旁邊的 filename + ".bin"
+PackedClauses readCNF(const string &filename, int &D, bool use_cache = true) {
+    PackedClauses clauses;
+    D = 0;
+
+    MappedFile file(filename);
+    if (!file.data) return clauses;  // 檔案不存在或是空的
+
+    string cachename = filename + ".bin";
+    if (use_cache && loadCache(cachename, file.info, clauses, D)) return clauses;
+
+    clauses.start.reserve(file.size / 8);
+    clauses.lits.reserve(file.size / 3);
+    bool dimacs = filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".cnf") == 0;
+    if (dimacs) parseDIMACS(file.data, file.data + file.size, clauses, D);
+    else parseCSV(file.data, file.data + file.size, clauses, D);
+
+    if (use_cache) saveCache(cachename, file.info, clauses, D);
     return clauses;
 }
 
+// 固定寬度的子句：每個子句是連續的 K 個 literal (編碼同 PackedClauses)，不需要 start[] 間接取值
+// 子句長度在編譯期就確定，correspond / correspond_lanes 的內層迴圈會被完全展開
+template <int K>
+struct FixedClauses {
+    vector<array<uint32_t, K>> clauses;
+
+    // 呼叫前須確認每個子句都剛好 K 個 literal
+    explicit FixedClauses(const PackedClauses &packed) : clauses(packed.size()) {
+        for (size_t c = 0; c < packed.size(); ++c) copy(packed.begin(c), packed.end(c), clauses[c].begin());
+    }
+
+    size_t size() const { return clauses.size(); }
+    const uint32_t *begin(size_t c) const { return clauses[c].data(); }
+    const uint32_t *end(size_t c) const { return clauses[c].data() + K; }
+};
+
+bool all_width(const PackedClauses &clauses, uint32_t K) {
+    for (size_t c = 0; c < clauses.size(); ++c) {
+        if (clauses.start[c + 1] - clauses.start[c] != K) return false;
+    }
+    return true;
+}
+
+// 讀檔後依子句寬度挑選儲存方式：全部都是 3 個 literal 就用 FixedClauses<3>，否則用通用的 PackedClauses
+template <class F>
+auto with_clause_store(const PackedClauses &clauses, F &&f) {
+    if (clauses.size() > 0 && all_width(clauses, 3)) return f(FixedClauses<3>(clauses));
+    return f(clauses);
+}
+
+// ---- 搜尋樹統計：編譯時加 -DSAT_STATS 才會開啟，否則 STAT(...) 整段不產生任何程式碼 ----
+// 每個執行緒累加自己的計數器 (不用 atomic)，執行緒結束時才加進全域的總和
+#ifdef SAT_STATS
+#define STAT(...) __VA_ARGS__
+struct SearchStats {
+    vector<long long> nodes_per_depth;   // 每一層展開的節點數
+    long long leaves = 0;                // 走到葉節點 (全部賦值) 的次數
+    long long correspond_calls = 0;      // correspond / correspond_lanes 的呼叫次數
+    long long clauses_scanned = 0;       // 上面這些呼叫實際看過的子句數 (找到不滿足的子句就提早停止)
+    long long conflicts = 0;             // 剪枝 (HeuristicDFS) 或衝突 (CDCL) 的次數
+    long long backtracks = 0;            // 回頭改試另一個分支 (CDCL 為非時序回溯) 的次數
+
+    void node(int depth, long long k = 1) {
+        if (depth >= (int)nodes_per_depth.size()) nodes_per_depth.resize(depth + 1, 0);
+        nodes_per_depth[depth] += k;
+    }
+
+    // 一次展開完的子樹 (tail_search)：根在 depth 層、剩 r 個變數，leaf < 0 表示整棵都走過
+    // 走到第 leaf 個葉節點時，根以下第 L 層已走過 (leaf >> (r - L)) + 1 個節點
+    void subtree(int depth, int r, int leaf) {
+        for (int L = 1; L <= r; ++L) node(depth + L, leaf < 0 ? 1LL << L : (leaf >> (r - L)) + 1);
+        leaves += leaf < 0 ? 1LL << r : leaf + 1;
+    }
+
+    void merge(const SearchStats &o) {
+        if (o.nodes_per_depth.size() > nodes_per_depth.size()) nodes_per_depth.resize(o.nodes_per_depth.size(), 0);
+        for (size_t d = 0; d < o.nodes_per_depth.size(); ++d) nodes_per_depth[d] += o.nodes_per_depth[d];
+        leaves += o.leaves;
+        correspond_calls += o.correspond_calls;
+        clauses_scanned += o.clauses_scanned;
+        conflicts += o.conflicts;
+        backtracks += o.backtracks;
+    }
+};
+
+// Chrome trace 的一段時間 ("ph": "X")
+struct TraceEvent {
+    string name, file;
+    int tid;
+    double ts, dur;  // 微秒，從程式開始算
+};
+
+// 結束的執行緒的計數總和與所有的時間段
+struct StatsRegistry {
+    mutex m;
+    SearchStats retired;
+    vector<TraceEvent> events;
+    atomic<int> next_tid{0};
+    chrono::steady_clock::time_point epoch = chrono::steady_clock::now();
+};
+StatsRegistry stats_registry;
+
+struct ThreadStats {
+    SearchStats stats;
+    int tid = stats_registry.next_tid.fetch_add(1);
+    ~ThreadStats() {
+        lock_guard<mutex> lock(stats_registry.m);
+        stats_registry.retired.merge(stats);
+    }
+};
+thread_local ThreadStats thread_stats;
+
+inline SearchStats &tls_stats() { return thread_stats.stats; }
+
+// 目前為止的總和：已結束的執行緒 + 呼叫者自己 (其他執行緒必須都已 join)
+SearchStats stats_snapshot() {
+    lock_guard<mutex> lock(stats_registry.m);
+    SearchStats total = stats_registry.retired;
+    total.merge(tls_stats());
+    return total;
+}
+
+// 範圍內的時間記成一段 trace，例如 StatPhase phase("search", filename);
+struct StatPhase {
+    string name, file;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    StatPhase(string n, string f = "") : name(move(n)), file(move(f)) {}
+    ~StatPhase() {
+        auto end = chrono::steady_clock::now();
+        auto us = [](auto d) { return chrono::duration<double, micro>(d).count(); };
+        lock_guard<mutex> lock(stats_registry.m);
+        stats_registry.events.push_back({name, file, thread_stats.tid, us(start - stats_registry.epoch), us(end - start)});
+    }
+};
+#else
+#define STAT(...)
+#endif
+
 // 看是否滿足 3-SAT
-bool correspond(const vector<vector<int>> &clauses, const vector<int> &assignment) {
-    for (const auto &clause : clauses) {
-        bool clauseSatisfied = false;
-        for (int literal : clause) {
-            int varIndex = abs(literal) - 1;
-            bool value = assignment[varIndex];  // 賦值
-            if (literal < 0) value = !value;    // 若是負號則取反
-            if (value) {
-                clauseSatisfied = true;
-                break;
-            }
+template <class Clauses>
+bool correspond(const Clauses &clauses, const vector<int> &assignment) {
+    STAT(tls_stats().correspond_calls++);
+    for (size_t c = 0; c < clauses.size(); ++c) {
+        int clauseSatisfied = 0;
+        for (const uint32_t *lit = clauses.begin(c); lit != clauses.end(c); ++lit) {
+            clauseSatisfied |= assignment[*lit >> 1] ^ (*lit & 1);  // 若是負號則取反
+        }
+        if (!clauseSatisfied) {  // 有任何子句不滿足 --> 返回 false
+            STAT(tls_stats().clauses_scanned += c + 1);
+            return false;
         }
-        if (!clauseSatisfied) return false;  // 有任何子句不滿足 --> 返回 false
     }
+    STAT(tls_stats().clauses_scanned += clauses.size());
     return true;
 }
 
-// DFS 搜尋（加入節點上限）
-bool DeepFS(vector<vector<int>> &clauses, vector<int> &assignment, int varIndex, int &expanded_nodes, int max_nodes) {
-    if (expanded_nodes >= max_nodes) return false;  // 超過節點上限，返回 false
+// 一次檢查 64*W 組賦值：lanes[var * W + w] 的第 b 個位元為第 (w*64 + b) 組賦值中該變數的值
+// 回傳每個 word 裡滿足所有子句的組別遮罩 (W = 4 時編譯器可展開成 256-bit 向量運算)
+template <int W, class Clauses>
+array<uint64_t, W> correspond_lanes(const Clauses &clauses, const vector<uint64_t> &lanes) {
+    array<uint64_t, W> ok;
+    ok.fill(~0ULL);
+    STAT(tls_stats().correspond_calls++);
+    STAT(size_t scanned = clauses.size());
+    for (size_t c = 0; c < clauses.size(); ++c) {
+        array<uint64_t, W> sat{};
+        for (const uint32_t *lit = clauses.begin(c); lit != clauses.end(c); ++lit) {
+            uint64_t flip = 0 - (uint64_t)(*lit & 1);  // 負號 --> 全部位元取反
+            const uint64_t *x = &lanes[(*lit >> 1) * W];
+            for (int w = 0; w < W; ++w) sat[w] |= x[w] ^ flip;
+        }
+        uint64_t alive = 0;
+        for (int w = 0; w < W; ++w) alive |= (ok[w] &= sat[w]);
+        if (!alive) {  // 每一組都已失敗，不用再看剩下的子句
+            STAT(scanned = c + 1);
+            break;
+        }
+    }
+    STAT(tls_stats().clauses_scanned += scanned);
+    return ok;
+}
+
+const int TAIL_VARS = 8;  // 剩下幾個變數以內改用 bit-parallel 一次檢查整棵子樹
 
-    expanded_nodes++;  // 記錄已展開的節點數
+// 把剩下的 r 個變數 (varIndex 開始) 的 2^r 個葉節點一次檢查完
+// 葉節點 l 依 DFS 順序編號，第一個剩餘變數是 l 的最高位元；回傳第一個可滿足的 l，沒有則回傳 -1
+template <int W, class Clauses>
+int tail_search(const Clauses &clauses, const vector<int> &assignment, int varIndex) {
+    static const uint64_t pattern[6] = {
+        0xAAAAAAAAAAAAAAAAULL, 0xCCCCCCCCCCCCCCCCULL, 0xF0F0F0F0F0F0F0F0ULL,
+        0xFF00FF00FF00FF00ULL, 0xFFFF0000FFFF0000ULL, 0xFFFFFFFF00000000ULL};
+    thread_local vector<uint64_t> lanes;
 
-    if (varIndex == assignment.size()) {
+    int D = assignment.size(), r = D - varIndex;
+    lanes.resize((size_t)D * W);
+    for (int v = 0; v < varIndex; ++v) {  // 已賦值的變數：每一組都相同
+        for (int w = 0; w < W; ++w) lanes[v * W + w] = assignment[v] ? ~0ULL : 0;
+    }
+    for (int j = 0; j < r; ++j) {         // 剩下的變數：依在葉節點編號中的位元位置展開
+        int bit = r - 1 - j;
+        for (int w = 0; w < W; ++w) {
+            lanes[(varIndex + j) * W + w] = bit < 6 ? pattern[bit] : (((w >> (bit - 6)) & 1) ? ~0ULL : 0);
+        }
+    }
+
+    array<uint64_t, W> ok = correspond_lanes<W>(clauses, lanes);
+    int leaves = 1 << r;
+    for (int w = 0; w < W && w * 64 < leaves; ++w) {
+        uint64_t valid = leaves - w * 64 >= 64 ? ~0ULL : (1ULL << (leaves - w * 64)) - 1;
+        if (ok[w] & valid) return w * 64 + __builtin_ctzll(ok[w] & valid);
+    }
+    return -1;
+}
+
+// 牆鐘時間上限 (seconds <= 0 表示不限)：每 4096 次檢查才真的讀一次時鐘
+struct Deadline {
+    chrono::steady_clock::time_point end = chrono::steady_clock::time_point::max();
+    unsigned ticks = 0;
+    bool passed = false;
+
+    Deadline() = default;
+    explicit Deadline(double seconds) {
+        if (seconds > 0) end = chrono::steady_clock::now() + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(seconds));
+    }
+
+    bool expired() {
+        if (!passed && (++ticks & 4095) == 0 && end != chrono::steady_clock::time_point::max()) {
+            passed = chrono::steady_clock::now() >= end;
+        }
+        return passed;
+    }
+};
+
+// 單執行緒的節點上限：直接累加 expanded_nodes
+struct SerialBudget {
+    long long &expanded_nodes;
+    long long max_nodes;
+    Deadline deadline;
+    bool cut_off = false;  // 曾因節點或時間上限拿不到額度；沒有的話搜完沒找到解就是無解
+
+    // 取得 k 個節點的額度，不夠就一個都不拿
+    bool take(long long k) {
+        if (expanded_nodes + k > max_nodes || deadline.expired()) return cut_off = true, false;
+        expanded_nodes += k;
+        return true;
+    }
+    void refund(long long k) { expanded_nodes -= k; }
+};
+
+// DFS 搜尋（加入節點上限）
+template <class Clauses, class Budget>
+bool DeepFS(const Clauses &clauses, vector<int> &assignment, int varIndex, Budget &budget) {
+    if (!budget.take(1)) return false;  // 超過節點上限，返回 false
+    STAT(tls_stats().node(varIndex));
+
+    if (varIndex == (int)assignment.size()) {
+        STAT(tls_stats().leaves++);
         return correspond(clauses, assignment);
     }
 
+    // 剩下的子樹夠小且節點上限內展得完 --> bit-parallel 一次檢查，節點數與逐一展開時相同
+    int r = assignment.size() - varIndex;
+    int subtree = r <= TAIL_VARS ? (2 << r) - 2 : 0;
+    if (r <= TAIL_VARS && budget.take(subtree)) {
+        int leaf = r <= 6 ? tail_search<1>(clauses, assignment, varIndex) : tail_search<4>(clauses, assignment, varIndex);
+        STAT(tls_stats().subtree(varIndex, r, leaf));
+        if (leaf < 0) return false;  // 整棵子樹都展開過
+
+        // DFS 走到第 leaf 個葉節點為止展開的節點數：往右走時要先走完整棵左子樹
+        int visited = 0;
+        for (int j = 0; j < r; ++j) {
+            int bit = (leaf >> (r - 1 - j)) & 1;
+            assignment[varIndex + j] = bit;
+            visited += 1 + (bit ? (2 << (r - 1 - j)) - 1 : 0);
+        }
+        budget.refund(subtree - visited);
+        return true;
+    }
+
     // try 變數為 0
     assignment[varIndex] = 0;
-    if (DeepFS(clauses, assignment, varIndex + 1, expanded_nodes, max_nodes)) return true;
+    if (DeepFS(clauses, assignment, varIndex + 1, budget)) return true;
 
     // try 變數為 1
+    STAT(tls_stats().backtracks++);
     assignment[varIndex] = 1;
-    if (DeepFS(clauses, assignment, varIndex + 1, expanded_nodes, max_nodes)) return true;
+    if (DeepFS(clauses, assignment, varIndex + 1, budget)) return true;
 
     return false;
 }
 
+template <class Clauses>
+bool DeepFS(const Clauses &clauses, vector<int> &assignment, int varIndex, long long &expanded_nodes, long long max_nodes,
+            double time_limit = 0) {
+    SerialBudget budget{expanded_nodes, max_nodes, Deadline(time_limit)};
+    return DeepFS(clauses, assignment, varIndex, budget);
+}
 
-int main() {
-    vector<int> dim = {10, 20, 30, 40, 50};  // 要處理的 D 值
-    ofstream outFile("result.txt");          // 輸出結果到 txt 檔案
+const long long NODE_BATCH = 1024;  // 每個執行緒一次向全域計數器預借的節點數
+
+// 多執行緒共用的搜尋狀態：全域節點計數、第一個找到的解、取消旗標
+struct SharedSearch {
+    atomic<long long> expanded_nodes{0};
+    long long max_nodes;
+    atomic<bool> stop{false};
+    atomic<bool> found{false};
+    atomic<bool> cut_off{false};  // 有執行緒因節點或時間上限而停下
+    vector<int> solution;
+    Deadline deadline;
+
+    SharedSearch(long long max, double time_limit) : max_nodes(max), deadline(time_limit) {}
+};
+
+// 執行緒自己的節點額度：用完才以 CAS 向全域預借一批，結束時把沒用完的還回去
+// 全域計數永遠不超過 max_nodes，因此 D^3 上限與單執行緒時的意義相同
+struct ThreadBudget {
+    SharedSearch &shared;
+    long long granted = 0, used = 0;
+    Deadline deadline = shared.deadline;  // 每個執行緒各自計數、各自讀時鐘
+
+    bool take(long long k) {
+        if (shared.stop.load(memory_order_relaxed)) return false;  // 其他執行緒已找到解
+        if (deadline.expired()) return shared.cut_off = true, false;
+        if (granted - used < k) {
+            long long want = max(k - (granted - used), NODE_BATCH);
+            long long cur = shared.expanded_nodes.load(memory_order_relaxed);
+            long long got;
+            do {
+                got = min(want, shared.max_nodes - cur);
+                if (got <= 0) break;
+            } while (!shared.expanded_nodes.compare_exchange_weak(cur, cur + got, memory_order_relaxed));
+            if (got > 0) granted += got;
+            if (granted - used < k) return shared.cut_off = true, false;
+        }
+        used += k;
+        return true;
+    }
+    void refund(long long k) { used -= k; }
+
+    ~ThreadBudget() { shared.expanded_nodes.fetch_sub(granted - used, memory_order_relaxed); }
+};
+
+// 每個執行緒一個工作佇列：自己從前端拿 (維持 DFS 順序)，偷別人的從尾端拿
+struct WorkDeque {
+    mutex m;
+    deque<int> jobs;
+};
+
+// 平行 DFS：前 k 個變數展開成 2^k 個前綴工作，以 work-stealing 分給各執行緒
+// unsat_out 不為空時寫入是否在上限內搜完整棵樹 (證明無解)
+template <class Clauses>
+bool ParallelDFS(const Clauses &clauses, vector<int> &assignment, long long &expanded_nodes, long long max_nodes,
+                 int num_threads, int split, double time_limit = 0, bool *unsat_out = nullptr) {
+    int D = assignment.size();
+    int k = min({split, D, 30});
+    while (k > 0 && (1LL << k) - 1 > max_nodes) k--;  // 前綴的內部節點也要算在上限內
+
+    SharedSearch shared(max_nodes, time_limit);
+    shared.expanded_nodes = (1LL << k) - 1;  // 第 0 ~ k-1 層的節點由主執行緒一次算掉
+    STAT(for (int d = 0; d < k; ++d) tls_stats().node(d, 1LL << d));
+
+    int jobs = 1 << k;
+    vector<WorkDeque> queues(num_threads);
+    for (int p = 0; p < jobs; ++p) {  // 連續的前綴分給同一個執行緒
+        queues[(long long)p * num_threads / jobs].jobs.push_back(p);
+    }
+
+    auto next_job = [&](int id, int &job) {
+        {
+            lock_guard<mutex> lock(queues[id].m);
+            if (!queues[id].jobs.empty()) {
+                job = queues[id].jobs.front();
+                queues[id].jobs.pop_front();
+                return true;
+            }
+        }
+        for (int i = 1; i < num_threads; ++i) {  // 自己的做完了 --> 去偷
+            WorkDeque &victim = queues[(id + i) % num_threads];
+            lock_guard<mutex> lock(victim.m);
+            if (!victim.jobs.empty()) {
+                job = victim.jobs.back();
+                victim.jobs.pop_back();
+                return true;
+            }
+        }
+        return false;
+    };
+
+    auto worker = [&](int id) {
+        STAT(StatPhase phase("pdfs worker " + to_string(id)));
+        ThreadBudget budget{shared};
+        vector<int> local(D, 0);
+        int job;
+        while (!shared.stop.load(memory_order_relaxed) && next_job(id, job)) {
+            for (int j = 0; j < k; ++j) local[j] = (job >> (k - 1 - j)) & 1;
+            if (DeepFS(clauses, local, k, budget)) {
+                bool expected = false;
+                if (shared.found.compare_exchange_strong(expected, true)) {  // 第一個找到的執行緒才寫回
+                    shared.solution = local;
+                    shared.stop = true;
+                }
+                break;
+            }
+        }
+    };
+
+    vector<thread> threads;
+    for (int id = 0; id < num_threads; ++id) threads.emplace_back(worker, id);
+    for (auto &t : threads) t.join();
+
+    expanded_nodes = shared.expanded_nodes;
+    if (shared.found) assignment = shared.solution;
+    if (unsat_out) *unsat_out = !shared.found && !shared.cut_off;
+    return shared.found;
+}
+
+// VSIDS 用的 max-heap：依 activity 排序 (同分時編號小的在前)，pos[v] = -1 表示 v 不在堆裡
+// 取分數最高的變數為 O(1)，插入、移除與加分為 O(log n)
+struct ActivityHeap {
+    vector<double> activity;
+    vector<int> heap, pos;
+
+    explicit ActivityHeap(int n = 0) : activity(n, 0.0), pos(n, -1) {}
+
+    bool less(int a, int b) const { return activity[a] < activity[b] || (activity[a] == activity[b] && a > b); }
+    void sift_up(int i) {
+        int v = heap[i];
+        while (i > 0 && less(heap[(i - 1) / 2], v)) {
+            heap[i] = heap[(i - 1) / 2];
+            pos[heap[i]] = i;
+            i = (i - 1) / 2;
+        }
+        heap[i] = v;
+        pos[v] = i;
+    }
+    void sift_down(int i) {
+        int v = heap[i], size = heap.size();
+        while (2 * i + 1 < size) {
+            int child = 2 * i + 1;
+            if (child + 1 < size && less(heap[child], heap[child + 1])) child++;
+            if (!less(v, heap[child])) break;
+            heap[i] = heap[child];
+            pos[heap[i]] = i;
+            i = child;
+        }
+        heap[i] = v;
+        pos[v] = i;
+    }
+
+    bool empty() const { return heap.empty(); }
+    int top() const { return heap[0]; }
+    bool contains(int v) const { return pos[v] >= 0; }
+    void insert(int v) {
+        if (contains(v)) return;
+        heap.push_back(v);
+        sift_up(heap.size() - 1);
+    }
+    void remove(int v) {
+        int i = pos[v], last = heap.back();
+        heap.pop_back();
+        pos[v] = -1;
+        if (last == v) return;
+        heap[i] = last;  // 以最後一個補位後往上或往下調整
+        pos[last] = i;
+        sift_up(i);
+        sift_down(pos[last]);
+    }
+    void bump(int v, double inc) {
+        activity[v] += inc;
+        if (contains(v)) sift_up(pos[v]);
+    }
+    void scale(double f) {  // 整體縮放，順序不變
+        for (double &a : activity) a *= f;
+    }
+};
+
+// 依啟發式選擇分支變數的 DFS：每次賦值後只檢查含有「變成假的 literal」的子句，一旦有子句全為假就剪枝
+// 變數順序：file 依檔案順序，moms / jw 讀檔後算一次固定順序，vsids 依衝突子句動態調整分數
+// 值的順序：先試 0 (與 DeepFS 相同) 或沿用這個變數上一次的值 (polarity caching)
+struct HeuristicDFS {
+    int n;
+    string order;                       // file、moms、jw 或 vsids
+    bool cache_polarity;
+    vector<uint32_t> lits, start;       // 子句 (編碼同 PackedClauses)
+    vector<uint32_t> occ, occ_start;    // occ[occ_start[lit] ..]：含有 lit 的子句
+    vector<int> false_count;            // 每個子句目前為假的 literal 數
+    vector<int> value;                  // -1 為未賦值
+    vector<int> phase;                  // 上一次的值
+    vector<int> static_order;           // file / moms / jw 的固定順序
+    ActivityHeap vsids;                 // vsids 的分數與未賦值變數的 heap
+    double var_inc = 1.0;
+    bool empty_clause = false;
+    bool unsat = false;                 // solve() 在上限內搜完整棵樹 (或有空子句) 而沒找到解
+
+    HeuristicDFS(const PackedClauses &clauses, int D, const string &order_name, bool cache)
+        : n(D), order(order_name), cache_polarity(cache), value(D, -1), phase(D, 0), vsids(D) {
+        lits = clauses.lits;
+        start = clauses.start;
+        occ_start.assign(2 * n + 1, 0);
+        for (uint32_t lit : lits) occ_start[lit + 1]++;
+        for (int l = 0; l < 2 * n; ++l) occ_start[l + 1] += occ_start[l];
+        occ.resize(lits.size());
+        vector<uint32_t> fill(occ_start.begin(), occ_start.end() - 1);
+        for (size_t c = 0; c < clauses.size(); ++c) {
+            if (start[c] == start[c + 1]) empty_clause = true;
+            for (uint32_t k = start[c]; k < start[c + 1]; ++k) occ[fill[lits[k]]++] = c;
+        }
+        false_count.assign(clauses.size(), 0);
+
+        // MOMs：只看最短的子句，分數 (f(x) + f(-x)) * 2^10 + f(x) * f(-x)
+        // Jeroslow-Wang (雙邊)：每個含有 x 或 -x 的子句貢獻 2^-|子句長度|
+        vector<double> score(n, 0.0);
+        if (order == "moms") {
+            uint32_t shortest = UINT32_MAX;
+            for (size_t c = 0; c < clauses.size(); ++c) shortest = min(shortest, start[c + 1] - start[c]);
+            vector<double> f(2 * n, 0.0);
+            for (size_t c = 0; c < clauses.size(); ++c) {
+                if (start[c + 1] - start[c] != shortest) continue;
+                for (uint32_t k = start[c]; k < start[c + 1]; ++k) f[lits[k]] += 1;
+            }
+            for (int v = 0; v < n; ++v) score[v] = (f[2 * v] + f[2 * v + 1]) * 1024 + f[2 * v] * f[2 * v + 1];
+        } else if (order == "jw") {
+            for (size_t c = 0; c < clauses.size(); ++c) {
+                double w = ldexp(1.0, -(int)(start[c + 1] - start[c]));
+                for (uint32_t k = start[c]; k < start[c + 1]; ++k) score[lits[k] >> 1] += w;
+            }
+        }
+        static_order.resize(n);
+        for (int v = 0; v < n; ++v) static_order[v] = v;
+        stable_sort(static_order.begin(), static_order.end(), [&](int a, int b) { return score[a] > score[b]; });
+
+        if (order == "vsids") {
+            for (int v = 0; v < n; ++v) vsids.insert(v);
+        }
+    }
+
+    // 衝突子句裡的變數加分，之後的加分量變大 (等同舊分數衰減)
+    void bump_clause(int c) {
+        for (uint32_t k = start[c]; k < start[c + 1]; ++k) vsids.bump(lits[k] >> 1, var_inc);
+        var_inc /= 0.95;
+        if (var_inc > 1e100) {
+            vsids.scale(1e-100);
+            var_inc *= 1e-100;
+        }
+    }
+
+    // 賦值並更新為假的 literal 數；回傳第一個全為假的子句，沒有則回傳 -1
+    int assign(int v, int val) {
+        value[v] = val;
+        phase[v] = val;
+        if (order == "vsids") vsids.remove(v);
+        uint32_t false_lit = 2 * v + val;
+        int conflict = -1;
+        for (uint32_t i = occ_start[false_lit]; i < occ_start[false_lit + 1]; ++i) {
+            int c = occ[i];
+            if (++false_count[c] == (int)(start[c + 1] - start[c]) && conflict < 0) conflict = c;
+        }
+        return conflict;
+    }
+
+    void unassign(int v) {
+        uint32_t false_lit = 2 * v + value[v];
+        for (uint32_t i = occ_start[false_lit]; i < occ_start[false_lit + 1]; ++i) false_count[occ[i]]--;
+        value[v] = -1;
+        if (order == "vsids") vsids.insert(v);
+    }
+
+    int pick(int depth) const { return order == "vsids" ? vsids.top() : static_order[depth]; }
+
+    // 與 DeepFS 相同，每進入一個節點算一個展開的節點；剛賦值就衝突的節點不再往下展開
+    template <class Budget>
+    bool search(int depth, int conflict, Budget &budget) {
+        if (!budget.take(1)) return false;  // 超過節點上限，返回 false
+        STAT(tls_stats().node(depth));
+        if (conflict >= 0) {
+            STAT(tls_stats().conflicts++);
+            if (order == "vsids") bump_clause(conflict);
+            return false;
+        }
+        if (depth == n) {  // 全部賦值且沒有子句全為假 --> 滿足
+            STAT(tls_stats().leaves++);
+            return true;
+        }
+
+        int v = pick(depth);
+        int first = cache_polarity ? phase[v] : 0;
+        for (int t = 0; t < 2; ++t) {
+            int c = assign(v, first ^ t);
+            if (search(depth + 1, c, budget)) return true;
+            unassign(v);
+            STAT(tls_stats().backtracks++);
+        }
+        return false;
+    }
+
+    bool solve(vector<int> &assignment, long long &expanded_nodes, long long max_nodes, double time_limit = 0) {
+        if (empty_clause) return unsat = true, false;
+        SerialBudget budget{expanded_nodes, max_nodes, Deadline(time_limit)};
+        if (!search(0, -1, budget)) return unsat = !budget.cut_off, false;
+        assignment = value;
+        return true;
+    }
+};
+
+// 可中斷、可續跑的 DFS：以明確的堆疊取代遞迴，計數器皆為 64-bit
+// 堆疊即 assignment[0 .. depth-1]：第 d 層目前走的分支，與 DeepFS 每一層遞迴的 assignment 相同
+// 搜尋狀態可以存成 checkpoint 檔，節點或時間用完後以更大的上限接著搜
+template <class Clauses>
+struct IterativeDFS {
+    enum Status { RUNNING, FOUND, EXHAUSTED };
+
+    const Clauses &clauses;
+    vector<int> assignment;
+    int depth = 0;                // 下一個要展開的節點在第幾層
+    long long expanded_nodes = 0;
+    double elapsed = 0;           // 歷次執行累計的搜尋時間 (秒)
+    Status status = RUNNING;
+
+    IterativeDFS(const Clauses &c, int D) : clauses(c), assignment(D, 0) {}
+
+    // 回到最近一個還沒試過 1 的祖先，沒有的話整棵樹已搜完
+    bool backtrack() {
+        while (depth > 0 && assignment[depth - 1] == 1) depth--;
+        if (depth == 0) return false;
+        assignment[depth - 1] = 1;
+        STAT(tls_stats().backtracks++);
+        return true;
+    }
+
+    // 搜尋到找到解、整棵樹搜完、超過節點上限或超過時間 (time_limit <= 0 表示不限) 為止
+    Status run(long long max_nodes, double time_limit) {
+        auto start = chrono::steady_clock::now();
+        int D = assignment.size();
+        long long steps = 0;
+
+        while (status == RUNNING) {
+            if (expanded_nodes >= max_nodes) break;  // 超過節點上限 --> 暫停
+            if (time_limit > 0 && (++steps & 4095) == 0 &&
+                chrono::duration<double>(chrono::steady_clock::now() - start).count() >= time_limit) break;
+
+            expanded_nodes++;  // 記錄已展開的節點數
+            STAT(tls_stats().node(depth));
+
+            int r = D - depth;
+            if (r == 0) {
+                STAT(tls_stats().leaves++);
+                if (correspond(clauses, assignment)) status = FOUND;
+            } else if (r <= TAIL_VARS && expanded_nodes + (2 << r) - 2 <= max_nodes) {
+                // 與 DeepFS 相同：bit-parallel 檢查整棵子樹，節點數與逐一展開時相同
+                int leaf = r <= 6 ? tail_search<1>(clauses, assignment, depth) : tail_search<4>(clauses, assignment, depth);
+                STAT(tls_stats().subtree(depth, r, leaf));
+                if (leaf < 0) {
+                    expanded_nodes += (2 << r) - 2;
+                } else {
+                    for (int j = 0; j < r; ++j) {
+                        int bit = (leaf >> (r - 1 - j)) & 1;
+                        assignment[depth + j] = bit;
+                        expanded_nodes += 1 + (bit ? (2 << (r - 1 - j)) - 1 : 0);
+                    }
+                    depth = D;
+                    status = FOUND;
+                }
+            } else {
+                assignment[depth++] = 0;  // try 變數為 0
+                continue;
+            }
+
+            if (status == RUNNING && !backtrack()) status = EXHAUSTED;  // try 變數為 1
+        }
+
+        elapsed += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        return status;
+    }
+
+    // checkpoint 先寫到暫存檔再改名，寫到一半中斷也不會弄壞舊的檔案
+    bool save(const string &filename, const string &instance) const {
+        string tmp = filename + ".tmp";
+        ofstream out(tmp);
+        out << "IterativeDFS checkpoint\n"
+            << "instance " << instance << "\n"
+            << "vars " << assignment.size() << "\n"
+            << "expanded_nodes " << expanded_nodes << "\n"
+            << "elapsed " << elapsed << "\n"
+            << "status " << status << "\n"
+            << "depth " << depth << "\n"
+            << "stack ";
+        for (int d = 0; d < depth; ++d) out << assignment[d];
+        out << "\n";
+        out.close();
+        if (!out) return false;
+        return rename(tmp.c_str(), filename.c_str()) == 0;
+    }
+
+    // 讀回 checkpoint；檔案不存在或與目前的檔案/變數數不符時回傳 false
+    bool load(const string &filename, const string &instance) {
+        ifstream in(filename);
+        string header, key, name, stack;
+        size_t vars;
+        int st;
+        long long nodes;
+        double secs;
+        int d;
+        if (!getline(in, header) || header != "IterativeDFS checkpoint") return false;
+        if (!(in >> key >> name) || key != "instance" || name != instance) return false;
+        if (!(in >> key >> vars) || key != "vars" || vars != assignment.size()) return false;
+        if (!(in >> key >> nodes) || key != "expanded_nodes") return false;
+        if (!(in >> key >> secs) || key != "elapsed") return false;
+        if (!(in >> key >> st) || key != "status" || st < RUNNING || st > EXHAUSTED) return false;
+        if (!(in >> key >> d) || key != "depth" || d < 0 || d > (int)vars) return false;
+        if (!(in >> key) || key != "stack") return false;
+        if (d > 0 && (!(in >> stack) || (int)stack.size() != d)) return false;
+
+        for (int i = 0; i < d; ++i) {
+            if (stack[i] != '0' && stack[i] != '1') return false;
+            assignment[i] = stack[i] - '0';
+        }
+        depth = d;
+        expanded_nodes = nodes;
+        elapsed = secs;
+        status = (Status)st;
+        return true;
+    }
+};
+
+// CDCL 搜尋核心：two-watched-literal 單元傳播 + 衝突子句學習 + 非時序回溯
+// 內部 literal 編碼為 2*var + (負號 ? 1 : 0)，lit ^ 1 即為其反面
+struct CDCL {
+    int n;
+    vector<vector<int>> db;       // 原始子句 + 學習到的子句
+    vector<vector<int>> watches;  // watches[lit]：目前監看 lit 的子句編號
+    vector<int> value;            // 變數賦值 (-1 為未賦值)
+    vector<int> level;            // 變數被賦值時的決策層
+    vector<int> reason;           // 推導出該變數的子句 (-1 為決策)
+    vector<int> trail;            // 依序記錄被賦值的 literal
+    vector<int> trail_lim;        // 每一決策層在 trail 的起點
+    size_t qhead = 0;             // 下一個要傳播的 trail 位置
+    ActivityHeap vsids;           // VSIDS 分數與尚未賦值的變數
+    double var_inc = 1.0;
+    vector<int> phase;            // 上一次的值 (phase saving)，初始為 0 與 DeepFS 相同
+    vector<char> seen;
+    bool unsat = false;           // 無解：讀入時就已矛盾 (空子句或互斥的單元子句)，或搜尋中第 0 層衝突
+    long long nodes = 0;          // 已展開的節點數：每一次賦值 (決策或推導) 算一個節點
+
+    CDCL(const PackedClauses &clauses, int D)
+        : n(D), watches(2 * D), value(D, -1), level(D, 0), reason(D, -1),
+          vsids(D), phase(D, 0), seen(D, 0) {
+        for (int v = 0; v < n; ++v) vsids.insert(v);
+        for (size_t ci = 0; ci < clauses.size(); ++ci) {
+            vector<int> c;
+            bool tautology = false;
+            for (uint32_t k = clauses.start[ci]; k < clauses.start[ci + 1]; ++k) {
+                int lit = clauses.lits[k];  // PackedClauses 的編碼與這裡相同
+                if (find(c.begin(), c.end(), lit) != c.end()) continue;       // 重複的 literal
+                if (find(c.begin(), c.end(), lit ^ 1) != c.end()) tautology = true;
+                c.push_back(lit);
+            }
+            if (tautology) continue;  // 恆真子句不影響結果
+            if (c.empty()) { unsat = true; continue; }
+            if (c.size() == 1) {      // 單元子句直接在第 0 層賦值
+                if (lit_value(c[0]) == 0) unsat = true;
+                else if (lit_value(c[0]) == -1) enqueue(c[0], -1);
+                continue;
+            }
+            attach(c);
+        }
+    }
+
+    int decision_level() const { return trail_lim.size(); }
+
+    // literal 的值：1 為真、0 為假、-1 為未賦值
+    int lit_value(int lit) const {
+        int v = value[lit >> 1];
+        return v < 0 ? -1 : v ^ (lit & 1);
+    }
 
-    for (int D : dim) {
-        string filename = "3SAT_Dim=" + to_string(D) + ".csv";
-        int D_num;
-        vector<vector<int>> clauses = readCSV(filename, D_num);
-        if (clauses.empty()) continue;  // 若檔案不存在則跳過
+    void attach(const vector<int> &c) {
+        db.push_back(c);
+        watches[c[0]].push_back(db.size() - 1);
+        watches[c[1]].push_back(db.size() - 1);
+    }
+
+    void enqueue(int lit, int from) {
+        int v = lit >> 1;
+        value[v] = (lit & 1) ^ 1;
+        level[v] = decision_level();
+        reason[v] = from;
+        trail.push_back(lit);
+        nodes++;
+        STAT(tls_stats().node(decision_level()));
+    }
 
-        vector<int> assignment(D_num, 0); // 初始變數賦值全為 0
-        int expanded_nodes = 0;                 // 記錄節點數
-        int max_nodes = pow(D, 3);              // 節點最多D的3次方
-        
-        auto start_time = chrono::high_resolution_clock::now(); // 計時start
+    // 單元傳播：回傳衝突子句編號，沒有衝突則回傳 -1
+    int propagate() {
+        while (qhead < trail.size()) {
+            int false_lit = trail[qhead++] ^ 1;
+            vector<int> &ws = watches[false_lit];
+            size_t i = 0, j = 0;
+            while (i < ws.size()) {
+                int ci = ws[i++];
+                vector<int> &c = db[ci];
+                if (c[0] == false_lit) swap(c[0], c[1]);  // 讓變成假的 literal 固定在 c[1]
 
-        bool found = DeepFS(clauses, assignment, 0, expanded_nodes, max_nodes);
-        
-        auto end_time = chrono::high_resolution_clock::now();   // 計時end
-        // 計算執行時間
-        double duration = chrono::duration<double>(end_time - start_time).count();
+                if (lit_value(c[0]) == 1) { ws[j++] = ci; continue; }  // 子句已滿足
 
+                // 找另一個不為假的 literal 來監看
+                bool moved = false;
+                for (size_t k = 2; k < c.size(); ++k) {
+                    if (lit_value(c[k]) != 0) {
+                        swap(c[1], c[k]);
+                        watches[c[1]].push_back(ci);
+                        moved = true;
+                        break;
+                    }
+                }
+                if (moved) continue;
+
+                ws[j++] = ci;
+                if (lit_value(c[0]) == 0) {  // 全部為假 --> 衝突
+                    while (i < ws.size()) ws[j++] = ws[i++];
+                    ws.resize(j);
+                    qhead = trail.size();
+                    return ci;
+                }
+                enqueue(c[0], ci);  // 只剩 c[0] 可滿足 --> 強制賦值
+            }
+            ws.resize(j);
+        }
+        return -1;
+    }
+
+    void bump(int v) {
+        vsids.bump(v, var_inc);
+        if (vsids.activity[v] > 1e100) {  // 避免溢位，整體縮放
+            vsids.scale(1e-100);
+            var_inc *= 1e-100;
+        }
+    }
+
+    // 1-UIP 衝突分析：產生學習子句 (learnt[0] 為 UIP 的反面)，回傳要回溯到的決策層
+    int analyze(int confl, vector<int> &learnt) {
+        learnt.assign(1, -1);
+        int pathC = 0, p = -1;
+        int idx = trail.size() - 1;
+
+        do {
+            const vector<int> &c = db[confl];
+            for (size_t k = (p == -1 ? 0 : 1); k < c.size(); ++k) {  // 推導子句的 c[0] 是 p 本身
+                int v = c[k] >> 1;
+                if (seen[v] || level[v] == 0) continue;
+                seen[v] = 1;
+                bump(v);
+                if (level[v] == decision_level()) pathC++;
+                else learnt.push_back(c[k]);
+            }
+            while (!seen[trail[idx] >> 1]) idx--;
+            p = trail[idx--];
+            confl = reason[p >> 1];
+            seen[p >> 1] = 0;
+            pathC--;
+        } while (pathC > 0);
+        learnt[0] = p ^ 1;
+
+        // 回溯層 = 學習子句中第二高的決策層，並把該 literal 放到 learnt[1] 作為監看
+        int back_level = 0;
+        for (size_t k = 1; k < learnt.size(); ++k) {
+            if (level[learnt[k] >> 1] > back_level) {
+                back_level = level[learnt[k] >> 1];
+                swap(learnt[1], learnt[k]);
+            }
+        }
+        for (int lit : learnt) seen[lit >> 1] = 0;
+        var_inc /= 0.95;
+        return back_level;
+    }
 
+    // 非時序回溯：撤銷 lvl 層以上的所有賦值
+    void cancel_until(int lvl) {
+        if (decision_level() <= lvl) return;
+        for (size_t i = trail_lim[lvl]; i < trail.size(); ++i) {
+            int v = trail[i] >> 1;
+            phase[v] = value[v];
+            value[v] = -1;
+            reason[v] = -1;
+            vsids.insert(v);
+        }
+        trail.resize(trail_lim[lvl]);
+        trail_lim.resize(lvl);
+        qhead = trail.size();
+    }
+
+    // 選擇 VSIDS 分數最高的未賦值變數，全部賦值完成則回傳 -1
+    // 賦值時不從 heap 移除，取到已賦值的變數才丟掉 (回溯時再放回)
+    int pick_branch() {
+        while (!vsids.empty() && value[vsids.top()] >= 0) vsids.remove(vsids.top());
+        return vsids.empty() ? -1 : vsids.top();
+    }
+
+    // 搜尋 (加入節點上限與時間上限)，找到解時寫回 assignment
+    bool solve(vector<int> &assignment, long long &expanded_nodes, long long max_nodes, double time_limit = 0) {
+        bool found = false;
+        vector<int> learnt;
+        Deadline deadline(time_limit);
+
+        while (!unsat) {
+            int confl = propagate();
+            if (confl >= 0) {
+                STAT(tls_stats().conflicts++);
+                if (decision_level() == 0) { unsat = true; break; }  // 第 0 層衝突 --> 無解
+                int back_level = analyze(confl, learnt);
+                cancel_until(back_level);
+                STAT(tls_stats().backtracks++);
+                if (learnt.size() == 1) {
+                    enqueue(learnt[0], -1);
+                } else {
+                    attach(learnt);
+                    enqueue(learnt[0], db.size() - 1);
+                }
+                continue;
+            }
+
+            if (nodes >= max_nodes || deadline.expired()) break;  // 超過節點或時間上限，返回 false
+
+            int v = pick_branch();
+            if (v < 0) {
+                STAT(tls_stats().leaves++);
+                found = true;
+                break;
+            }
+            trail_lim.push_back(trail.size());
+            enqueue(2 * v + (phase[v] == 0), -1);  // 依 phase 決定先試 0 或 1
+        }
+
+        expanded_nodes = nodes;
         if (found) {
-            outFile << "Solution found. Expanded nodes: " << expanded_nodes << ". Time taken: " << duration << " seconds\n"<< endl;
-            cout << "Solution found for " << filename << ". Expanded nodes: " << expanded_nodes << ". Time taken: " << duration << " seconds\n"<< endl;
-            outFile << "Assignment:";
-            for (int i = 0; i < D_num; i++) {
-                outFile << " " << assignment[i];
+            for (int v = 0; v < n; ++v) assignment[v] = value[v];
+        }
+        return found;
+    }
+};
+
+
+// 隨機區域搜尋 (WalkSAT / ProbSAT)：從隨機賦值開始，每次在某個未滿足的子句裡挑一個變數翻轉
+// 維護每個變數的 break/make 數與未滿足子句清單，一次翻轉只需更新含有該變數的子句
+struct LocalSearch {
+    int n;
+    vector<uint32_t> lits, start;       // 去掉重複 literal 與恆真子句後的子句 (編碼同 PackedClauses)
+    vector<uint32_t> occ, occ_start;    // occ[occ_start[lit] ..]：含有 lit 的子句
+    vector<int> value;
+    vector<int> true_count;             // 每個子句中為真的 literal 數
+    vector<int> true_xor;               // 為真的變數編號 XOR 起來，true_count == 1 時就是唯一為真的變數
+    vector<int> break_count;            // 翻轉後會變成未滿足的子句數 (該變數是唯一為真的 literal)
+    vector<int> make_count;             // 翻轉後會變成滿足的子句數
+    vector<int> unsat, unsat_pos;       // 未滿足的子句清單與各子句在清單中的位置 (-1 為已滿足)
+    vector<double> prob_table;          // ProbSAT 依 break 數的權重 (eps + break)^-cb，eps = 1
+    vector<double> weight;              // ProbSAT 挑選時的暫存
+    mt19937_64 rng;
+    long long flips = 0;
+    bool empty_clause = false;
+
+    LocalSearch(const PackedClauses &clauses, int D, uint64_t seed)
+        : n(D), value(D, 0), break_count(D, 0), make_count(D, 0), rng(seed) {
+        start.push_back(0);
+        for (size_t ci = 0; ci < clauses.size(); ++ci) {
+            size_t begin = lits.size();
+            bool tautology = false;
+            for (uint32_t k = clauses.start[ci]; k < clauses.start[ci + 1]; ++k) {
+                uint32_t lit = clauses.lits[k];
+                if (find(lits.begin() + begin, lits.end(), lit) != lits.end()) continue;
+                if (find(lits.begin() + begin, lits.end(), lit ^ 1) != lits.end()) tautology = true;
+                lits.push_back(lit);
             }
-            outFile << "\n\n";
-        } else {
-            outFile << "No solution found for " << filename << ". Expanded nodes: " << expanded_nodes << ". Time taken: " << duration << " seconds\n"<< endl;
-            cout << "No solution found for " << filename << ". Expanded nodes: " << expanded_nodes << ". Time taken: " << duration << " seconds\n"<< endl;
+            if (tautology) { lits.resize(begin); continue; }  // 恆真子句永遠滿足
+            if (lits.size() == begin) empty_clause = true;
+            start.push_back(lits.size());
         }
+
+        size_t m = start.size() - 1;
+        occ_start.assign(2 * n + 1, 0);
+        for (uint32_t lit : lits) occ_start[lit + 1]++;
+        for (int l = 0; l < 2 * n; ++l) occ_start[l + 1] += occ_start[l];
+        occ.resize(lits.size());
+        vector<uint32_t> fill(occ_start.begin(), occ_start.end() - 1);
+        for (size_t c = 0; c < m; ++c) {
+            for (uint32_t k = start[c]; k < start[c + 1]; ++k) occ[fill[lits[k]]++] = c;
+        }
+        true_count.assign(m, 0);
+        true_xor.assign(m, 0);
+        unsat_pos.assign(m, -1);
+    }
+
+    bool lit_true(uint32_t lit) const { return value[lit >> 1] ^ (lit & 1); }
+
+    void add_unsat(int c) {
+        unsat_pos[c] = unsat.size();
+        unsat.push_back(c);
+    }
+    void remove_unsat(int c) {  // 與最後一個交換後刪除
+        int last = unsat.back();
+        unsat[unsat_pos[c]] = last;
+        unsat_pos[last] = unsat_pos[c];
+        unsat.pop_back();
+        unsat_pos[c] = -1;
+    }
+
+    // 隨機賦值並從頭計算所有計數
+    void restart() {
+        for (int v = 0; v < n; ++v) value[v] = rng() & 1;
+        fill_n(break_count.begin(), n, 0);
+        fill_n(make_count.begin(), n, 0);
+        unsat.clear();
+        for (size_t c = 0; c + 1 < start.size(); ++c) {
+            true_count[c] = true_xor[c] = 0;
+            unsat_pos[c] = -1;
+            for (uint32_t k = start[c]; k < start[c + 1]; ++k) {
+                if (lit_true(lits[k])) {
+                    true_count[c]++;
+                    true_xor[c] ^= lits[k] >> 1;
+                }
+            }
+            if (true_count[c] == 0) {
+                add_unsat(c);
+                for (uint32_t k = start[c]; k < start[c + 1]; ++k) make_count[lits[k] >> 1]++;
+            } else if (true_count[c] == 1) {
+                break_count[true_xor[c]]++;
+            }
+        }
+    }
+
+    void flip(int v) {
+        value[v] ^= 1;
+        flips++;
+        uint32_t now_true = 2 * v + (value[v] ^ 1), now_false = now_true ^ 1;
+
+        for (uint32_t i = occ_start[now_true]; i < occ_start[now_true + 1]; ++i) {
+            int c = occ[i];
+            true_xor[c] ^= v;
+            if (++true_count[c] == 1) {         // 未滿足 --> 滿足，v 是唯一為真的
+                remove_unsat(c);
+                for (uint32_t k = start[c]; k < start[c + 1]; ++k) make_count[lits[k] >> 1]--;
+                break_count[v]++;
+            } else if (true_count[c] == 2) {    // 原本唯一為真的變數不再是 critical
+                break_count[true_xor[c] ^ v]--;
+            }
+        }
+        for (uint32_t i = occ_start[now_false]; i < occ_start[now_false + 1]; ++i) {
+            int c = occ[i];
+            true_xor[c] ^= v;
+            if (--true_count[c] == 0) {         // 滿足 --> 未滿足
+                add_unsat(c);
+                for (uint32_t k = start[c]; k < start[c + 1]; ++k) make_count[lits[k] >> 1]++;
+                break_count[v]--;
+            } else if (true_count[c] == 1) {    // 剩下的那一個變數變成 critical
+                break_count[true_xor[c]]++;
+            }
+        }
+    }
+
+    // WalkSAT (SKC)：有 break = 0 的變數就翻它，否則以 noise 的機率隨機翻，其餘翻 break 最小的
+    int pick_walksat(int c, double noise) {
+        uint32_t b = start[c], e = start[c + 1];
+        int best = -1, best_break = INT32_MAX, ties = 0;
+        for (uint32_t k = b; k < e; ++k) {
+            int v = lits[k] >> 1;
+            int br = break_count[v];
+            if (br < best_break || (br == best_break && make_count[v] > make_count[best])) {
+                best = v;
+                best_break = br;
+                ties = 1;
+            } else if (br == best_break && make_count[v] == make_count[best] && rng() % ++ties == 0) {
+                best = v;  // 同分時隨機選 (reservoir sampling)
+            }
+        }
+        if (best_break > 0 && uniform_real_distribution<double>(0, 1)(rng) < noise) {
+            return lits[b + rng() % (e - b)] >> 1;
+        }
+        return best;
+    }
+
+    // ProbSAT：依 (eps + break)^-cb 的比例隨機挑選
+    int pick_probsat(int c) {
+        uint32_t b = start[c], e = start[c + 1];
+        double total = 0;
+        for (uint32_t k = b; k < e; ++k) total += (weight[k - b] = prob_table[break_count[lits[k] >> 1]]);
+        double r = uniform_real_distribution<double>(0, total)(rng);
+        for (uint32_t k = b; k < e; ++k) {
+            if (r < weight[k - b]) return lits[k] >> 1;
+            r -= weight[k - b];
+        }
+        return lits[e - 1] >> 1;
+    }
+
+    // 最多 restarts 次，每次最多 max_flips 次翻轉；probsat 為 false 時跑 WalkSAT
+    bool solve(vector<int> &assignment, bool probsat, long long max_flips, int restarts, double noise, double cb, int &tries,
+               double time_limit = 0) {
+        if (empty_clause) return false;
+        Deadline deadline(time_limit);
+        uint32_t max_occ = 0, max_len = 0;  // break 數不會超過出現次數
+        for (int l = 0; l < 2 * n; ++l) max_occ = max(max_occ, occ_start[l + 1] - occ_start[l]);
+        for (size_t c = 0; c + 1 < start.size(); ++c) max_len = max(max_len, start[c + 1] - start[c]);
+        prob_table.resize(max_occ + 1);
+        for (size_t b = 0; b < prob_table.size(); ++b) prob_table[b] = pow(1.0 + b, -cb);
+        weight.resize(max_len);
+
+        for (tries = 1; tries <= restarts; ++tries) {
+            restart();
+            for (long long f = 0; f < max_flips && !unsat.empty() && !deadline.expired(); ++f) {
+                int c = unsat[rng() % unsat.size()];
+                flip(probsat ? pick_probsat(c) : pick_walksat(c, noise));
+            }
+            if (unsat.empty()) {
+                assignment = value;
+                return true;
+            }
+            if (deadline.expired()) return false;
+        }
+        tries = restarts;
+        return false;
+    }
+};
+
+// 基準測試：先跑 warmup 次不計時，再計時 reps 次，回報中位數、p95 與吞吐量 (work / 中位數)
+struct BenchResult {
+    string name;
+    string unit;        // 吞吐量單位，例如 nodes/s
+    double work;        // 每次執行的工作量
+    vector<double> secs;
+    double median = 0, p95 = 0;
+};
+
+template <class F>
+BenchResult run_bench(const string &name, const string &unit, double work, int warmup, int reps, F &&f) {
+    BenchResult r{name, unit, work, {}};
+    for (int i = 0; i < warmup; ++i) f();
+    for (int i = 0; i < reps; ++i) {
+        auto t0 = chrono::steady_clock::now();
+        f();
+        r.secs.push_back(chrono::duration<double>(chrono::steady_clock::now() - t0).count());
+    }
+    vector<double> sorted = r.secs;
+    sort(sorted.begin(), sorted.end());
+    r.median = sorted[sorted.size() / 2];
+    r.p95 = sorted[min(sorted.size() - 1, (size_t)ceil(0.95 * sorted.size()) - 1)];
+    cout << name << ": median " << r.median << " s, p95 " << r.p95 << " s, "
+         << (r.median > 0 ? work / r.median : 0) << " " << unit << endl;
+    return r;
+}
+
+// 依副檔名輸出 JSON 或 CSV
+void save_bench(const string &filename, const string &program, const vector<BenchResult> &results) {
+    ofstream out(filename);
+    bool json = filename.size() >= 5 && filename.compare(filename.size() - 5, 5, ".json") == 0;
+    if (json) {
+        out << "{\"program\": \"" << program << "\", \"results\": [\n";
+        for (size_t i = 0; i < results.size(); ++i) {
+            const BenchResult &r = results[i];
+            out << "  {\"name\": \"" << r.name << "\", \"reps\": " << r.secs.size() << ", \"median_s\": " << r.median
+                << ", \"p95_s\": " << r.p95 << ", \"throughput\": " << (r.median > 0 ? r.work / r.median : 0)
+                << ", \"unit\": \"" << r.unit << "\", \"samples_s\": [";
+            for (size_t k = 0; k < r.secs.size(); ++k) out << (k ? ", " : "") << r.secs[k];
+            out << "]}" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        out << "]}\n";
+    } else {
+        out << "program,name,reps,median_s,p95_s,throughput,unit\n";
+        for (const BenchResult &r : results) {
+            out << program << "," << r.name << "," << r.secs.size() << "," << r.median << "," << r.p95 << ","
+                << (r.median > 0 ? r.work / r.median : 0) << "," << r.unit << "\n";
+        }
+    }
+}
+
+// 解析逗號分隔的整數清單，例如 --bench-sizes=50,100,200
+vector<int> parse_list(const string &s) {
+    vector<int> v;
+    stringstream ss(s);
+    string token;
+    while (getline(ss, token, ',')) v.push_back(stoi(token));
+    return v;
+}
+
+// 隨機產生有解的 3-SAT：先隨機決定一組解 (hidden)，只保留被這組解滿足的子句
+PackedClauses generate_3sat(int D, int m, uint64_t seed, vector<int> &hidden) {
+    mt19937_64 rng(seed);
+    hidden.assign(D, 0);
+    for (int &x : hidden) x = rng() & 1;
+    PackedClauses clauses;
+    while ((int)clauses.size() < m) {
+        int lit[3];
+        bool ok = false;
+        for (int j = 0; j < 3; ++j) {
+            int v = rng() % D;
+            lit[j] = (rng() & 1) ? v + 1 : -(v + 1);
+            ok |= (lit[j] > 0) == (bool)hidden[v];
+        }
+        if (!ok) continue;
+        for (int l : lit) clauses.add_literal(l);
+        clauses.end_clause();
+    }
+    return clauses;
+}
+
+// 對每個 D 產生子句數 4.26*D 的實例，量測各個核心與整體求解
+vector<BenchResult> run_benchmarks(const vector<int> &sizes, int warmup, int reps) {
+    vector<BenchResult> results;
+    volatile long long sink = 0;  // 寫入 volatile，避免結果沒被用到而被編譯器省略
+
+    for (int D : sizes) {
+        string tag = "/D=" + to_string(D);
+        vector<int> assignment;
+        PackedClauses clauses = generate_3sat(D, (int)(4.26 * D), D, assignment);
+        mt19937 rng(D);
+
+        // correspond：每次計時 1000 次檢查；用可滿足的賦值，才會掃過所有子句
+        const int calls = 1000;
+        results.push_back(run_bench("correspond" + tag, "evals/s", calls, warmup, reps, [&] {
+            for (int i = 0; i < calls; ++i) sink = sink + correspond(clauses, assignment);
+        }));
+
+        // correspond_lanes：一次檢查 256 組賦值；第 0 組放可滿足的賦值，其餘隨機
+        vector<uint64_t> lanes((size_t)D * 4);
+        for (size_t i = 0; i < lanes.size(); ++i) {
+            lanes[i] = ((uint64_t)rng() << 32) | rng();
+            if (i % 4 == 0) lanes[i] = (lanes[i] & ~1ULL) | assignment[i / 4];
+        }
+        FixedClauses<3> fixed(clauses);
+        results.push_back(run_bench("correspond_k3" + tag, "evals/s", calls, warmup, reps, [&] {
+            for (int i = 0; i < calls; ++i) sink = sink + correspond(fixed, assignment);
+        }));
+
+        results.push_back(run_bench("correspond_lanes" + tag, "evals/s", 256.0 * calls, warmup, reps, [&] {
+            for (int i = 0; i < calls; ++i) sink = sink + correspond_lanes<4>(clauses, lanes)[0];
+        }));
+
+        // 讀檔：解析 CSV 與讀二進位快取
+        string csv = "bench_3sat_D=" + to_string(D) + ".csv";
+        {
+            ofstream out(csv);
+            for (size_t c = 0; c < clauses.size(); ++c) {
+                for (uint32_t k = clauses.start[c]; k < clauses.start[c + 1]; ++k) {
+                    uint32_t lit = clauses.lits[k];
+                    out << (k > clauses.start[c] ? ", " : "") << ((lit & 1) ? "-" : "+") << (lit >> 1) + 1;
+                }
+                out << "\n";
+            }
+        }
+        int loaded_D;
+        results.push_back(run_bench("readCNF_parse" + tag, "clauses/s", clauses.size(), warmup, reps, [&] {
+            sink = sink + readCNF(csv, loaded_D, false).size();
+        }));
+        readCNF(csv, loaded_D, true);
+        results.push_back(run_bench("readCNF_cache" + tag, "clauses/s", clauses.size(), warmup, reps, [&] {
+            sink = sink + readCNF(csv, loaded_D, true).size();
+        }));
+        remove(csv.c_str());
+        remove((csv + ".bin").c_str());
+
+        // 整體求解：工作量先跑一次取得 (結果是決定性的，每次都相同)
+        long long max_nodes = (long long)D * D * D, nodes = 0;
+        vector<int> solution(D);
+        CDCL(clauses, D).solve(solution, nodes, max_nodes);
+        results.push_back(run_bench("cdcl" + tag, "nodes/s", nodes, warmup, reps, [&] {
+            long long n = 0;
+            sink = sink + CDCL(clauses, D).solve(solution, n, max_nodes);
+        }));
+
+        nodes = 0;
+        DeepFS(clauses, solution, 0, nodes, max_nodes);
+        results.push_back(run_bench("dfs" + tag, "nodes/s", nodes, warmup, reps, [&] {
+            long long n = 0;
+            sink = sink + DeepFS(fixed, solution, 0, n, max_nodes);
+        }));
+
+        for (string order : {"file", "moms", "jw", "vsids"}) {
+            nodes = 0;
+            HeuristicDFS(clauses, D, order, false).solve(solution, nodes, max_nodes);
+            results.push_back(run_bench("dfs_" + order + tag, "nodes/s", nodes, warmup, reps, [&] {
+                long long n = 0;
+                sink = sink + HeuristicDFS(clauses, D, order, false).solve(solution, n, max_nodes);
+            }));
+        }
+
+        int tries;
+        LocalSearch probe(clauses, D, 1);
+        probe.solve(solution, false, 1000000, 1, 0.567, 2.38, tries);
+        results.push_back(run_bench("walksat" + tag, "flips/s", probe.flips, warmup, reps, [&] {
+            LocalSearch search(clauses, D, 1);
+            sink = sink + search.solve(solution, false, 1000000, 1, 0.567, 2.38, tries);
+        }));
+    }
+    return results;
+}
+
+// 命令列選項
+struct Options {
+    // cdcl (預設)、dfs (依 --order 選變數、衝突即剪枝的 DFS)、pdfs (多執行緒 DFS)、idfs (可續跑的 DFS)、walksat 或 probsat (區域搜尋)
+    string mode = "cdcl";
+    int num_threads = max(1u, thread::hardware_concurrency());
+    int split = -1;                          // pdfs 前綴的變數個數，預設約每個執行緒 16 個工作
+    long long node_limit = -1;               // 覆蓋預設的 D^3 節點上限
+    double time_limit = 0;                   // 每個檔案的時間上限 (秒)，0 為不限
+    bool resume = false;                     // idfs 是否從上次的 checkpoint 接著搜
+    string order = "file";                   // dfs 的變數順序：file (依檔案順序)、moms、jw 或 vsids
+    bool cache_polarity = false;             // dfs 先試上一次的值 (cache) 而不是 0 (zero)
+    bool use_cache = true;                   // 讀寫 .bin 二進位快取
+    long long max_flips = 1000000;           // walksat/probsat 每次重新開始前的翻轉次數上限
+    int restarts = 10;                       // walksat/probsat 最多重新開始幾次
+    double noise = 0.567;                    // walksat 隨機翻轉的機率
+    double cb = 2.38;                        // probsat 的 break 權重指數
+    uint64_t seed = random_device{}();       // walksat/probsat 的亂數種子
+};
+
+// 一個檔案的求解結果
+struct InstanceResult {
+    bool loaded = false, found = false, paused = false;
+    bool unsat = false;                      // 證明無解：CDCL 第 0 層衝突，或 DFS 在上限內搜完整棵樹
+    int D_num = 0;
+    long long clauses = 0;
+    long long expanded_nodes = 0, max_nodes = 0;
+    long long flips = 0;
+    int tries = 0;
+    double duration = 0;
+    bool resumed = false;
+    double total_duration = 0;               // 從檢查點接續時，含這一次在內歷次執行累計的搜尋時間
+    vector<int> assignment;
+    string stats;                            // 結果行中間的統計，例如 "Expanded nodes: 123"
+};
+
+// 讀檔並以 opt.mode 求解；D 為 0 時以讀到的變數數量當 D，max_nodes 為 -1 時上限為 D^3
+InstanceResult solve_instance(const string &filename, int D, long long max_nodes, double time_limit, const Options &opt) {
+    InstanceResult r;
+    const string &mode = opt.mode;
+    int D_num;
+    PackedClauses clauses;
+    {
+        STAT(StatPhase phase("load", filename));
+        clauses = readCNF(filename, D_num, opt.use_cache);
+    }
+    if (clauses.size() == 0) return r;  // 檔案不存在
+    r.loaded = true;
+    r.D_num = D_num;
+    r.clauses = clauses.size();
+    if (D == 0) D = D_num;
+
+    vector<int> assignment(D_num, 0); // 初始變數賦值全為 0
+    long long expanded_nodes = 0;           // 記錄節點數
+    if (max_nodes < 0) max_nodes = (long long)D * D * D;  // 節點最多D的3次方
+    string checkpoint = filename + ".ckpt";
+    bool paused = false;
+
+    auto start_time = chrono::high_resolution_clock::now(); // 計時start
+    STAT(auto phase = make_unique<StatPhase>("search", filename));
+
+    bool found = false;
+    if (mode == "idfs") {
+        found = with_clause_store(clauses, [&](const auto &store) {
+            IterativeDFS search(store, D_num);
+            if (opt.resume && search.load(checkpoint, filename)) {
+                cout << "Resuming " << filename << " from " << checkpoint << " at " << search.expanded_nodes << " expanded nodes" << endl;
+                r.resumed = true;
+            }
+            auto status = search.run(max_nodes, time_limit);
+            r.total_duration = search.elapsed;
+            paused = status == search.RUNNING;
+            r.unsat = status == search.EXHAUSTED;
+            expanded_nodes = search.expanded_nodes;
+            assignment = search.assignment;
+            if (paused) search.save(checkpoint, filename);
+            else remove(checkpoint.c_str());
+            return status == search.FOUND;
+        });
+    }
+    else if (mode == "walksat" || mode == "probsat") {
+        LocalSearch search(clauses, D_num, opt.seed);
+        found = search.solve(assignment, mode == "probsat", opt.max_flips, opt.restarts, opt.noise, opt.cb, r.tries, time_limit);
+        r.flips = search.flips;
+    }
+    else if (mode == "dfs") {  // 每種順序都走 HeuristicDFS，比較順序時剪枝方式相同
+        HeuristicDFS search(clauses, D_num, opt.order, opt.cache_polarity);
+        found = search.solve(assignment, expanded_nodes, max_nodes, time_limit);
+        r.unsat = search.unsat;
+    }
+    else if (mode == "pdfs") {
+        int split = opt.split >= 0 ? opt.split : (int)ceil(log2(opt.num_threads * 16.0));
+        found = with_clause_store(clauses, [&](const auto &store) {
+            return ParallelDFS(store, assignment, expanded_nodes, max_nodes, opt.num_threads, split, time_limit, &r.unsat);
+        });
+    }
+    else if (mode == "cdcl") {
+        CDCL solver(clauses, D_num);
+        found = solver.solve(assignment, expanded_nodes, max_nodes, time_limit);
+        r.unsat = solver.unsat;
+    }
+
+    auto end_time = chrono::high_resolution_clock::now();   // 計時end
+    STAT(phase.reset());
+    // 計算執行時間
+    r.duration = chrono::duration<double>(end_time - start_time).count();
+
+    // 區域搜尋沒有展開節點，改報翻轉次數與每秒翻轉次數
+    r.stats = "Expanded nodes: " + to_string(expanded_nodes);
+    if (mode == "dfs") r.stats += " (order=" + opt.order + ", polarity=" + (opt.cache_polarity ? "cache" : "zero") + ")";
+    if (mode == "walksat" || mode == "probsat") {
+        ostringstream ss;
+        ss << "Flips: " << r.flips << ". Flips per second: " << (r.duration > 0 ? r.flips / r.duration : 0) << ". Tries: " << r.tries;
+        r.stats = ss.str();
+    }
+
+    r.found = found;
+    r.paused = paused;
+    r.expanded_nodes = expanded_nodes;
+    r.max_nodes = max_nodes;
+    r.assignment = move(assignment);
+    return r;
+}
+
+// 結果寫到 result.txt 與螢幕；從檢查點接續的執行另外列出歷次累計的時間
+void report_result(ostream &outFile, const string &filename, const InstanceResult &r) {
+    ostringstream time;
+    time << "Time taken: " << r.duration << " seconds";
+    if (r.resumed) time << " (" << r.total_duration << " seconds in total across resumed runs)";
+    if (r.found) {
+        outFile << "Solution found for " << filename << ". " << r.stats << ". " << time.str() << "\n"<< endl;
+        cout << "Solution found for " << filename << ". " << r.stats << ". " << time.str() << "\n"<< endl;
+        outFile << "Assignment:";
+        for (int i = 0; i < r.D_num; i++) {
+            outFile << " " << r.assignment[i];
+        }
+        outFile << "\n\n";
+    } else {
+        outFile << "No solution found for " << filename << ". " << r.stats << ". " << time.str() << "\n"<< endl;
+        cout << "No solution found for " << filename << ". " << r.stats << ". " << time.str() << "\n"<< endl;
+        if (r.paused) cout << "Search state saved to " << filename << ".ckpt (rerun with --resume and a larger --max-nodes/--time-limit)\n" << endl;
+    }
+}
+
+// 一般模式：依序求解命令列指定的檔案；沒指定檔案時跑預設的 D 值，指定的檔案以讀到的變數數量當 D
+void run_files(const vector<string> &files, const Options &opt) {
+    vector<pair<string, int>> instances;
+    for (const string &f : files) instances.push_back({f, 0});
+    if (instances.empty()) {
+        for (int D : {10, 20, 30, 40, 50}) instances.push_back({"3SAT_Dim=" + to_string(D) + ".csv", D});
+    }
+    ofstream outFile("result.txt");          // 輸出結果到 txt 檔案
+
+    for (auto [filename, D] : instances) {
+        InstanceResult r = solve_instance(filename, D, opt.node_limit, opt.time_limit, opt);
+        if (!r.loaded) continue;  // 若檔案不存在則跳過
+        STAT(StatPhase phase("output", filename));
+        report_result(outFile, filename, r);
     }
 
     outFile.close();
+}
+
+// 批次中的一個工作：各自的節點上限 (-1 為 D^3) 與時間上限，difficulty 用來決定先後
+struct BatchJob {
+    string filename;
+    long long max_nodes;
+    double time_limit;
+    uintmax_t difficulty;
+};
+
+// 收集批次工作：path 是目錄就取裡面所有 .csv / .cnf，否則當作清單檔
+// 清單檔每行：<檔案> [節點上限] [時間上限秒數]，# 之後為註解，讀不到的上限沿用命令列的值，相對路徑以清單檔所在目錄為準
+// path 不是目錄也讀不到時回傳 false
+bool collect_jobs(const string &path, const Options &opt, vector<BatchJob> &jobs) {
+    namespace fs = std::filesystem;
+    error_code ec;
+    if (fs::is_directory(path, ec)) {
+        for (const auto &entry : fs::directory_iterator(path, ec)) {
+            string ext = entry.path().extension().string();
+            if (entry.is_regular_file() && (ext == ".csv" || ext == ".cnf")) {
+                jobs.push_back({entry.path().string(), opt.node_limit, opt.time_limit, 0});
+            }
+        }
+    } else {
+        ifstream manifest(path);
+        if (!manifest) return false;
+        fs::path base = fs::path(path).parent_path();
+        string line;
+        while (getline(manifest, line)) {
+            istringstream ss(line.substr(0, line.find('#')));
+            BatchJob job{"", opt.node_limit, opt.time_limit, 0};
+            if (!(ss >> job.filename)) continue;
+            long long max_nodes;
+            double time_limit;
+            if (ss >> max_nodes) {
+                job.max_nodes = max_nodes;
+                if (ss >> time_limit) job.time_limit = time_limit;
+            }
+            if (fs::path(job.filename).is_relative()) job.filename = (base / job.filename).string();
+            jobs.push_back(job);
+        }
+    }
+
+    // 預估難度：以檔案大小 (約等於子句數) 估計，大的先跑，避免最難的檔案最後才開始而拖長整批時間
+    for (BatchJob &job : jobs) {
+        job.difficulty = fs::file_size(job.filename, ec);
+        if (ec) job.difficulty = 0;
+    }
+    stable_sort(jobs.begin(), jobs.end(), [](const BatchJob &a, const BatchJob &b) { return a.difficulty > b.difficulty; });
+    return true;
+}
+
+// JSON 字串跳脫
+string json_escape(const string &s) {
+    string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out;
+}
+
+#ifdef SAT_STATS
+// 統計輸出成 JSON：各計數器總和、每層節點數，以及 load / search / output 各花了多少秒
+void save_stats(const string &filename) {
+    SearchStats total = stats_snapshot();
+    double load = 0, search = 0, output = 0;
+    for (const TraceEvent &e : stats_registry.events) {
+        if (e.name == "load") load += e.dur / 1e6;
+        else if (e.name == "search") search += e.dur / 1e6;
+        else if (e.name == "output") output += e.dur / 1e6;
+    }
+    ofstream out(filename);
+    out << "{\n  \"leaves\": " << total.leaves << ",\n  \"correspond_calls\": " << total.correspond_calls
+        << ",\n  \"clauses_scanned\": " << total.clauses_scanned
+        << ",\n  \"clauses_per_call\": " << (total.correspond_calls ? (double)total.clauses_scanned / total.correspond_calls : 0)
+        << ",\n  \"conflicts\": " << total.conflicts << ",\n  \"backtracks\": " << total.backtracks
+        << ",\n  \"threads\": " << stats_registry.next_tid.load()
+        << ",\n  \"seconds\": {\"load\": " << load << ", \"search\": " << search << ", \"output\": " << output << "}"
+        << ",\n  \"nodes_per_depth\": [";
+    for (size_t d = 0; d < total.nodes_per_depth.size(); ++d) out << (d ? ", " : "") << total.nodes_per_depth[d];
+    out << "]\n}\n";
+}
+
+// Chrome trace (chrome://tracing 或 Perfetto 可開)：每一段時間一個 "X" 事件
+void save_trace(const string &filename) {
+    ofstream out(filename);
+    out << "{\"traceEvents\": [\n";
+    lock_guard<mutex> lock(stats_registry.m);
+    for (size_t i = 0; i < stats_registry.events.size(); ++i) {
+        const TraceEvent &e = stats_registry.events[i];
+        out << (i ? ",\n" : "") << "  {\"name\": \"" << json_escape(e.name) << "\", \"cat\": \"sat\", \"ph\": \"X\", \"pid\": 1, \"tid\": "
+            << e.tid << ", \"ts\": " << fixed << e.ts << ", \"dur\": " << e.dur << defaultfloat
+            << ", \"args\": {\"file\": \"" << json_escape(e.file) << "\"}}";
+    }
+    out << "\n], \"displayTimeUnit\": \"ms\"}\n";
+}
+#endif
+
+// 批次模式：固定大小的執行緒池依序領取工作，每完成一個就立刻寫入 result.txt 與 JSON Lines 檔
+// pdfs 的 --threads 由同時跑的 num_jobs 個工作平分，總執行緒數不超過 --threads
+bool run_batch(const string &path, int num_jobs, const string &json_path, Options opt) {
+    vector<BatchJob> jobs;
+    if (!collect_jobs(path, opt, jobs)) {
+        cerr << "Cannot read batch manifest " << path << endl;
+        return false;
+    }
+    cout << "Batch: " << jobs.size() << " instances on " << num_jobs << " threads";
+    if (opt.mode == "pdfs") {
+        opt.num_threads = max(1, opt.num_threads / num_jobs);
+        cout << ", " << opt.num_threads << " pdfs threads each";
+    }
+    cout << endl;
+
+    ofstream outFile("result.txt");
+    ofstream json(json_path);
+    mutex out_mutex;
+    atomic<size_t> next{0};
+    auto batch_start = chrono::steady_clock::now();
+
+    auto worker = [&] {
+        for (size_t i; (i = next.fetch_add(1)) < jobs.size();) {
+            const BatchJob &job = jobs[i];
+            InstanceResult r = solve_instance(job.filename, 0, job.max_nodes, job.time_limit, opt);
+            bool timed_out = !r.found && job.time_limit > 0 && r.duration >= job.time_limit;
+
+            lock_guard<mutex> lock(out_mutex);
+            STAT(StatPhase phase("output", job.filename));
+            if (!r.loaded) {
+                cerr << "Cannot read " << job.filename << endl;
+                json << "{\"file\": \"" << json_escape(job.filename) << "\", \"status\": \"error\"}" << endl;
+                continue;
+            }
+            report_result(outFile, job.filename, r);
+            outFile.flush();
+            json << "{\"file\": \"" << json_escape(job.filename) << "\", \"status\": \""
+                 << (r.found ? "sat" : r.unsat ? "unsat" : timed_out ? "timeout" : "unknown") << "\", \"mode\": \"" << opt.mode
+                 << "\", \"vars\": " << r.D_num << ", \"clauses\": " << r.clauses
+                 << ", \"expanded_nodes\": " << r.expanded_nodes << ", \"max_nodes\": " << r.max_nodes
+                 << ", \"flips\": " << r.flips << ", \"seconds\": " << r.duration;
+            if (r.resumed) json << ", \"total_seconds\": " << r.total_duration;
+            json << "}" << endl;
+        }
+    };
+
+    vector<thread> threads;
+    for (int t = 0; t < num_jobs; ++t) threads.emplace_back(worker);
+    for (auto &t : threads) t.join();
+
+    double total = chrono::duration<double>(chrono::steady_clock::now() - batch_start).count();
+    cout << "Batch done. " << jobs.size() << " instances in " << total << " seconds" << endl;
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    Options opt;
+    bool bench = false;                      // 跑基準測試而不是求解
+    vector<int> bench_sizes = {50, 100, 200};
+    int bench_warmup = 2, bench_reps = 10;
+    string bench_out = "bench_DFS.json";     // .json 或 .csv
+    string batch;                            // 批次模式的目錄或清單檔
+    int num_jobs = max(1u, thread::hardware_concurrency());  // 批次模式同時跑幾個檔案
+    string batch_json = "result.jsonl";      // 批次模式每完成一個檔案寫一行 JSON
+    string stats_out, trace_out;             // 搜尋統計 (JSON) 與 Chrome trace 的輸出檔，需以 -DSAT_STATS 編譯
+    vector<string> files;                    // 命令列指定的檔案 (CSV 或 DIMACS .cnf)
+    string polarity = "zero";
+    bool dfs_flags = false;                  // 有沒有指定只對 dfs 有效的 --order / --polarity
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg.rfind("--mode=", 0) == 0) opt.mode = arg.substr(7);
+        else if (arg.rfind("--threads=", 0) == 0) opt.num_threads = max(1, stoi(arg.substr(10)));
+        else if (arg.rfind("--split=", 0) == 0) opt.split = stoi(arg.substr(8));
+        else if (arg.rfind("--max-nodes=", 0) == 0) opt.node_limit = stoll(arg.substr(12));
+        else if (arg.rfind("--time-limit=", 0) == 0) opt.time_limit = stod(arg.substr(13));
+        else if (arg == "--resume") opt.resume = true;
+        else if (arg.rfind("--order=", 0) == 0) opt.order = arg.substr(8), dfs_flags = true;
+        else if (arg.rfind("--polarity=", 0) == 0) polarity = arg.substr(11), dfs_flags = true;
+        else if (arg == "--no-cache") opt.use_cache = false;
+        else if (arg.rfind("--max-flips=", 0) == 0) opt.max_flips = stoll(arg.substr(12));
+        else if (arg.rfind("--restarts=", 0) == 0) opt.restarts = max(1, stoi(arg.substr(11)));
+        else if (arg.rfind("--noise=", 0) == 0) opt.noise = stod(arg.substr(8));
+        else if (arg.rfind("--cb=", 0) == 0) opt.cb = stod(arg.substr(5));
+        else if (arg.rfind("--seed=", 0) == 0) opt.seed = stoull(arg.substr(7));
+        else if (arg == "--bench") bench = true;
+        else if (arg.rfind("--bench-sizes=", 0) == 0) bench_sizes = parse_list(arg.substr(14));
+        else if (arg.rfind("--bench-warmup=", 0) == 0) bench_warmup = max(0, stoi(arg.substr(15)));
+        else if (arg.rfind("--bench-reps=", 0) == 0) bench_reps = max(1, stoi(arg.substr(13)));
+        else if (arg.rfind("--bench-out=", 0) == 0) bench_out = arg.substr(12);
+        else if (arg.rfind("--batch=", 0) == 0) batch = arg.substr(8);
+        else if (arg.rfind("--jobs=", 0) == 0) num_jobs = max(1, stoi(arg.substr(7)));
+        else if (arg.rfind("--batch-json=", 0) == 0) batch_json = arg.substr(13);
+        else if (arg.rfind("--stats=", 0) == 0) stats_out = arg.substr(8);
+        else if (arg.rfind("--trace=", 0) == 0) trace_out = arg.substr(8);
+        else files.push_back(arg);
+    }
+    if (opt.mode != "cdcl" && opt.mode != "dfs" && opt.mode != "pdfs" && opt.mode != "idfs" && opt.mode != "walksat" && opt.mode != "probsat") {
+        cerr << "Unknown --mode=" << opt.mode << " (expected cdcl, dfs, pdfs, idfs, walksat or probsat)" << endl;
+        return 1;
+    }
+    if (opt.order != "file" && opt.order != "moms" && opt.order != "jw" && opt.order != "vsids") {
+        cerr << "Unknown --order=" << opt.order << " (expected file, moms, jw or vsids)" << endl;
+        return 1;
+    }
+    if (polarity != "zero" && polarity != "cache") {
+        cerr << "Unknown --polarity=" << polarity << " (expected zero or cache)" << endl;
+        return 1;
+    }
+    opt.cache_polarity = polarity == "cache";
+    if (dfs_flags && opt.mode != "dfs") {
+        cerr << "--order / --polarity only apply to --mode=dfs" << endl;
+        return 1;
+    }
+#ifndef SAT_STATS
+    if (!stats_out.empty() || !trace_out.empty()) cerr << "--stats / --trace need a build with -DSAT_STATS" << endl;
+#endif
+
+    if (bench) {
+        save_bench(bench_out, "DFS", run_benchmarks(bench_sizes, bench_warmup, bench_reps));
+        return 0;
+    }
+    if (!batch.empty()) {
+        if (!run_batch(batch, num_jobs, batch_json, opt)) return 1;
+    }
+    else run_files(files, opt);
+
+#ifdef SAT_STATS
+    if (!stats_out.empty()) save_stats(stats_out);
+    if (!trace_out.empty()) save_trace(trace_out);
+#endif
     return 0;
-}
\ No newline at end of file
+}
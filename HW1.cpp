@@ -3,6 +3,7 @@
 #include <fstream>
 #include <sstream>
 #include <algorithm>
+#include <climits>
 
 using namespace std;
 
@@ -38,40 +39,274 @@ vector<vector<int>> readCSV(const string &filename, int &D) {
     return clauses;
 }
 
-//看是否滿足 3-SAT
-bool correspond(const vector<vector<int>> &clauses, const vector<int> &assignment) {
-    for (const auto &clause : clauses) {
-        bool clauseSatisfied = false;
-        for (int literal : clause) {
-            int varIndex = abs(literal) - 1;
-            bool value = assignment[varIndex];  //賦值
-            if (literal < 0) value = !value;    //若是負號則取反
-            if (value) {
-                clauseSatisfied = true;
-                break;
+// VSIDS 用的 max-heap：依 activity 排序 (同分時編號小的在前)，pos[v] = -1 表示 v 不在堆裡
+// 取分數最高的變數為 O(1)，插入、移除與加分為 O(log n)
+struct ActivityHeap {
+    vector<double> activity;
+    vector<int> heap, pos;
+
+    explicit ActivityHeap(int n = 0) : activity(n, 0.0), pos(n, -1) {}
+
+    bool less(int a, int b) const { return activity[a] < activity[b] || (activity[a] == activity[b] && a > b); }
+    void sift_up(int i) {
+        int v = heap[i];
+        while (i > 0 && less(heap[(i - 1) / 2], v)) {
+            heap[i] = heap[(i - 1) / 2];
+            pos[heap[i]] = i;
+            i = (i - 1) / 2;
+        }
+        heap[i] = v;
+        pos[v] = i;
+    }
+    void sift_down(int i) {
+        int v = heap[i], size = heap.size();
+        while (2 * i + 1 < size) {
+            int child = 2 * i + 1;
+            if (child + 1 < size && less(heap[child], heap[child + 1])) child++;
+            if (!less(v, heap[child])) break;
+            heap[i] = heap[child];
+            pos[heap[i]] = i;
+            i = child;
+        }
+        heap[i] = v;
+        pos[v] = i;
+    }
+
+    bool empty() const { return heap.empty(); }
+    int top() const { return heap[0]; }
+    bool contains(int v) const { return pos[v] >= 0; }
+    void insert(int v) {
+        if (contains(v)) return;
+        heap.push_back(v);
+        sift_up(heap.size() - 1);
+    }
+    void remove(int v) {
+        int i = pos[v], last = heap.back();
+        heap.pop_back();
+        pos[v] = -1;
+        if (last == v) return;
+        heap[i] = last;  // 以最後一個補位後往上或往下調整
+        pos[last] = i;
+        sift_up(i);
+        sift_down(pos[last]);
+    }
+    void bump(int v, double inc) {
+        activity[v] += inc;
+        if (contains(v)) sift_up(pos[v]);
+    }
+    void scale(double f) {  // 整體縮放，順序不變
+        for (double &a : activity) a *= f;
+    }
+};
+
+// CDCL 搜尋核心：two-watched-literal 單元傳播 + 衝突子句學習 + 非時序回溯
+// 內部 literal 編碼為 2*var + (負號 ? 1 : 0)，lit ^ 1 即為其反面
+struct CDCL {
+    int n;
+    vector<vector<int>> db;       // 原始子句 + 學習到的子句
+    vector<vector<int>> watches;  // watches[lit]：目前監看 lit 的子句編號
+    vector<int> value;            // 變數賦值 (-1 為未賦值)
+    vector<int> level;            // 變數被賦值時的決策層
+    vector<int> reason;           // 推導出該變數的子句 (-1 為決策)
+    vector<int> trail;            // 依序記錄被賦值的 literal
+    vector<int> trail_lim;        // 每一決策層在 trail 的起點
+    size_t qhead = 0;             // 下一個要傳播的 trail 位置
+    ActivityHeap vsids;           // VSIDS 分數與尚未賦值的變數
+    double var_inc = 1.0;
+    vector<int> phase;            // 上一次的值 (phase saving)，初始為 0 (先試 0)
+    vector<char> seen;
+    bool unsat = false;           // 讀入時就已矛盾 (空子句或互斥的單元子句)
+    long long nodes = 0;          // 已展開的節點數：每一次賦值 (決策或推導) 算一個節點
+
+    CDCL(const vector<vector<int>> &clauses, int D)
+        : n(D), watches(2 * D), value(D, -1), level(D, 0), reason(D, -1),
+          vsids(D), phase(D, 0), seen(D, 0) {
+        for (int v = 0; v < n; ++v) vsids.insert(v);
+        for (const auto &clause : clauses) {
+            vector<int> c;
+            bool tautology = false;
+            for (int literal : clause) {
+                int lit = 2 * (abs(literal) - 1) + (literal < 0);
+                if (find(c.begin(), c.end(), lit) != c.end()) continue;       // 重複的 literal
+                if (find(c.begin(), c.end(), lit ^ 1) != c.end()) tautology = true;
+                c.push_back(lit);
+            }
+            if (tautology) continue;  // 恆真子句不影響結果
+            if (c.empty()) { unsat = true; continue; }
+            if (c.size() == 1) {      // 單元子句直接在第 0 層賦值
+                if (lit_value(c[0]) == 0) unsat = true;
+                else if (lit_value(c[0]) == -1) enqueue(c[0], -1);
+                continue;
             }
+            attach(c);
         }
-        if (!clauseSatisfied) return false;  //有任何子句不滿足-->返回 false
     }
-    return true;
-}
 
-//DFS搜尋
-bool DeepFS(vector<vector<int>> &clauses, vector<int> &assignment, int varIndex) {
-    if (varIndex == assignment.size()) {
-        return correspond(clauses, assignment);
+    int decision_level() const { return trail_lim.size(); }
+
+    // literal 的值：1 為真、0 為假、-1 為未賦值
+    int lit_value(int lit) const {
+        int v = value[lit >> 1];
+        return v < 0 ? -1 : v ^ (lit & 1);
     }
 
-    //try變數為 0
-    assignment[varIndex] = 0;
-    if (DeepFS(clauses, assignment, varIndex + 1)) return true;
+    void attach(const vector<int> &c) {
+        db.push_back(c);
+        watches[c[0]].push_back(db.size() - 1);
+        watches[c[1]].push_back(db.size() - 1);
+    }
 
-    //try變數為 1
-    assignment[varIndex] = 1;
-    if (DeepFS(clauses, assignment, varIndex + 1)) return true;
+    void enqueue(int lit, int from) {
+        int v = lit >> 1;
+        value[v] = (lit & 1) ^ 1;
+        level[v] = decision_level();
+        reason[v] = from;
+        trail.push_back(lit);
+        nodes++;
+    }
+
+    // 單元傳播：回傳衝突子句編號，沒有衝突則回傳 -1
+    int propagate() {
+        while (qhead < trail.size()) {
+            int false_lit = trail[qhead++] ^ 1;
+            vector<int> &ws = watches[false_lit];
+            size_t i = 0, j = 0;
+            while (i < ws.size()) {
+                int ci = ws[i++];
+                vector<int> &c = db[ci];
+                if (c[0] == false_lit) swap(c[0], c[1]);  // 讓變成假的 literal 固定在 c[1]
+
+                if (lit_value(c[0]) == 1) { ws[j++] = ci; continue; }  // 子句已滿足
+
+                // 找另一個不為假的 literal 來監看
+                bool moved = false;
+                for (size_t k = 2; k < c.size(); ++k) {
+                    if (lit_value(c[k]) != 0) {
+                        swap(c[1], c[k]);
+                        watches[c[1]].push_back(ci);
+                        moved = true;
+                        break;
+                    }
+                }
+                if (moved) continue;
+
+                ws[j++] = ci;
+                if (lit_value(c[0]) == 0) {  // 全部為假 --> 衝突
+                    while (i < ws.size()) ws[j++] = ws[i++];
+                    ws.resize(j);
+                    qhead = trail.size();
+                    return ci;
+                }
+                enqueue(c[0], ci);  // 只剩 c[0] 可滿足 --> 強制賦值
+            }
+            ws.resize(j);
+        }
+        return -1;
+    }
+
+    void bump(int v) {
+        vsids.bump(v, var_inc);
+        if (vsids.activity[v] > 1e100) {  // 避免溢位，整體縮放
+            vsids.scale(1e-100);
+            var_inc *= 1e-100;
+        }
+    }
+
+    // 1-UIP 衝突分析：產生學習子句 (learnt[0] 為 UIP 的反面)，回傳要回溯到的決策層
+    int analyze(int confl, vector<int> &learnt) {
+        learnt.assign(1, -1);
+        int pathC = 0, p = -1;
+        int idx = trail.size() - 1;
+
+        do {
+            const vector<int> &c = db[confl];
+            for (size_t k = (p == -1 ? 0 : 1); k < c.size(); ++k) {  // 推導子句的 c[0] 是 p 本身
+                int v = c[k] >> 1;
+                if (seen[v] || level[v] == 0) continue;
+                seen[v] = 1;
+                bump(v);
+                if (level[v] == decision_level()) pathC++;
+                else learnt.push_back(c[k]);
+            }
+            while (!seen[trail[idx] >> 1]) idx--;
+            p = trail[idx--];
+            confl = reason[p >> 1];
+            seen[p >> 1] = 0;
+            pathC--;
+        } while (pathC > 0);
+        learnt[0] = p ^ 1;
+
+        // 回溯層 = 學習子句中第二高的決策層，並把該 literal 放到 learnt[1] 作為監看
+        int back_level = 0;
+        for (size_t k = 1; k < learnt.size(); ++k) {
+            if (level[learnt[k] >> 1] > back_level) {
+                back_level = level[learnt[k] >> 1];
+                swap(learnt[1], learnt[k]);
+            }
+        }
+        for (int lit : learnt) seen[lit >> 1] = 0;
+        var_inc /= 0.95;
+        return back_level;
+    }
+
+    // 非時序回溯：撤銷 lvl 層以上的所有賦值
+    void cancel_until(int lvl) {
+        if (decision_level() <= lvl) return;
+        for (size_t i = trail_lim[lvl]; i < trail.size(); ++i) {
+            int v = trail[i] >> 1;
+            phase[v] = value[v];
+            value[v] = -1;
+            reason[v] = -1;
+            vsids.insert(v);
+        }
+        trail.resize(trail_lim[lvl]);
+        trail_lim.resize(lvl);
+        qhead = trail.size();
+    }
+
+    // 選擇 VSIDS 分數最高的未賦值變數，全部賦值完成則回傳 -1
+    // 賦值時不從 heap 移除，取到已賦值的變數才丟掉 (回溯時再放回)
+    int pick_branch() {
+        while (!vsids.empty() && value[vsids.top()] >= 0) vsids.remove(vsids.top());
+        return vsids.empty() ? -1 : vsids.top();
+    }
+
+    // 搜尋 (加入節點上限)，找到解時寫回 assignment
+    bool solve(vector<int> &assignment, long long &expanded_nodes, long long max_nodes) {
+        bool found = false;
+        vector<int> learnt;
+
+        while (!unsat) {
+            int confl = propagate();
+            if (confl >= 0) {
+                if (decision_level() == 0) { unsat = true; break; }  // 第 0 層衝突 --> 無解
+                int back_level = analyze(confl, learnt);
+                cancel_until(back_level);
+                if (learnt.size() == 1) {
+                    enqueue(learnt[0], -1);
+                } else {
+                    attach(learnt);
+                    enqueue(learnt[0], db.size() - 1);
+                }
+                continue;
+            }
+
+            if (nodes >= max_nodes) break;  // 超過節點上限，返回 false
+
+            int v = pick_branch();
+            if (v < 0) { found = true; break; }
+            trail_lim.push_back(trail.size());
+            enqueue(2 * v + (phase[v] == 0), -1);  // 依 phase 決定先試 0 或 1
+        }
+
+        expanded_nodes = nodes;
+        if (found) {
+            for (int v = 0; v < n; ++v) assignment[v] = value[v];
+        }
+        return found;
+    }
+};
 
-    return false;
-}
 
 // 主程式
 int main() {
@@ -85,9 +320,9 @@ int main() {
         if (clauses.empty()) continue;  // 若檔案不存在則跳過
 
         vector<int> assignment(var_counter, 0); // 初始變數賦值全為 0
-        
+        long long expanded_nodes = 0;           // 不設節點上限
 
-        if (DeepFS(clauses, assignment, 0)) {
+        if (CDCL(clauses, var_counter).solve(assignment, expanded_nodes, LLONG_MAX)) {
             for (int i = 0; i < var_counter; i++) {
                 cout << assignment[i];
                 outFile << assignment[i] << " ";
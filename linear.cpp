@@ -5,6 +5,22 @@
 #include <cmath>
 #include <random>
 #include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <new>
+#include <array>
+#include <atomic>
+#include <barrier>
+#include <thread>
+#include <charconv>
+#include <cstring>
+#include <string_view>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <immintrin.h>
 
 using namespace std;
 
@@ -13,58 +29,605 @@ const int pixel = 784; // 28x28 pixels
 const int max_epo = 10;
 const double lr = 0.01; // learning rate
 
-// 分割 CSV 行字串
-vector<string> split(const string& line, char delimiter) {
-    vector<string> tokens;
-    string token;
-    istringstream tokenStream(line);
-    while (getline(tokenStream, token, delimiter)) {
-        tokens.push_back(token);
+// ---- 資料配置：連續、每列對齊 64 bytes 的列優先 (row-major) 緩衝區 ----
+
+// 對齊 64 bytes 的配置器 (一條 cache line，也是 AVX-512 一個暫存器的寬度)
+template <class T>
+struct AlignedAlloc {
+    using value_type = T;
+    AlignedAlloc() = default;
+    template <class U>
+    AlignedAlloc(const AlignedAlloc<U> &) {}
+    T *allocate(size_t n) { return (T *)::operator new(n * sizeof(T), align_val_t(64)); }
+    void deallocate(T *p, size_t) { ::operator delete(p, align_val_t(64)); }
+    template <class U>
+    bool operator==(const AlignedAlloc<U> &) const { return true; }
+};
+
+// rows x cols 的矩陣；每列佔 stride 個元素 (補到 64 bytes 的倍數，多出來的補 0)，所以每列的起點都對齊
+template <class T>
+struct Matrix {
+    int rows = 0, cols = 0, stride = 0;
+    vector<T, AlignedAlloc<T>> data;
+
+    Matrix() = default;
+    Matrix(int r, int c) : cols(c), stride((int)((c * sizeof(T) + 63) / 64 * 64 / sizeof(T))) { resize(r); }
+
+    void resize(int r) {
+        rows = r;
+        data.resize((size_t)r * stride);
+    }
+    T *row(int r) { return data.data() + (size_t)r * stride; }
+    const T *row(int r) const { return data.data() + (size_t)r * stride; }
+};
+
+// 影像：每列一張，pixel 個 uint8 (0~255，除以 255 留到 kernel 裡做)，labels[i] 為第 i 張的答案
+struct Dataset {
+    Matrix<uint8_t> images{0, pixel};
+    vector<int> labels;
+
+    int size() const { return labels.size(); }
+    const uint8_t *image(int i) const { return images.row(i); }
+};
+
+// 模型：num x pixel 的 float 權重 (一整塊) 與 num 個 bias
+struct Model {
+    Matrix<float> W{num, pixel};
+    float b[num] = {};
+};
+
+// 開 T - 1 個執行緒 (主執行緒自己當第 0 個) 跑 f(t)，t = 0..T-1，全部做完才回傳
+template <class F>
+void run_threads(int T, F&& f) {
+    vector<thread> threads;
+    for (int t = 1; t < T; ++t) threads.emplace_back(f, t);
+    f(0);
+    for (auto &th : threads) th.join();
+}
+
+// ---- 讀取 MNIST CSV：mmap 整個檔案，依行切成幾段平行解析，from_chars 直接寫進 uint8 的影像緩衝區 ----
+
+// 唯讀 mmap 整個檔案；開不了或是空檔時 data 為 nullptr
+struct MappedFile {
+    const char *data = nullptr;
+    size_t size = 0;
+    struct stat info {};
+
+    explicit MappedFile(const string &filename) {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        if (fstat(fd, &info) == 0 && info.st_size > 0) {
+            void *p = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                data = (const char *)p;
+                size = info.st_size;
+            }
+        }
+        close(fd);
+    }
+    ~MappedFile() {
+        if (data) munmap((void *)data, size);
+    }
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+};
+
+// 二進位快取 (類似 IDX)：檔頭後接 labels[rows] 與 rows x pixels 個 uint8 像素 (不含 padding)
+struct DatasetCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t pixels;       // 每張影像的像素數 (CSV 的欄數 - 1)
+    uint64_t rows;
+    int64_t source_size;   // 原始檔的大小與修改時間，不符就表示快取已過期
+    int64_t source_mtime;  // 奈秒
+};
+const char DATASET_CACHE_MAGIC[8] = "MNISTU8";
+const uint32_t DATASET_CACHE_VERSION = 1;
+
+inline int64_t mtime_ns(const struct stat &st) { return (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec; }
+
+bool load_dataset_cache(const string &cachename, const struct stat &source, Dataset &data) {
+    MappedFile cache(cachename);
+    if (!cache.data || cache.size < sizeof(DatasetCacheHeader)) return false;
+
+    DatasetCacheHeader h;
+    memcpy(&h, cache.data, sizeof h);
+    if (memcmp(h.magic, DATASET_CACHE_MAGIC, sizeof h.magic) != 0 || h.version != DATASET_CACHE_VERSION) return false;
+    if (h.source_size != (int64_t)source.st_size || h.source_mtime != mtime_ns(source)) return false;
+    if (h.pixels > (uint32_t)pixel || cache.size != sizeof h + h.rows * (1 + h.pixels)) return false;
+
+    // label 與解析 CSV 時一樣必須小於 num，否則 batch_forward / evaluate 會越界，當作壞掉的快取重新解析
+    const uint8_t *labels = (const uint8_t *)cache.data + sizeof h, *images = labels + h.rows;
+    if (any_of(labels, labels + h.rows, [](uint8_t y) { return y >= num; })) return false;
+    data.images.resize(h.rows);
+    data.labels.assign(labels, labels + h.rows);
+    for (size_t r = 0; r < h.rows; ++r) memcpy(data.images.row(r), images + r * h.pixels, h.pixels);
+    return true;
+}
+
+// 快取先寫到暫存檔再改名；寫不進去 (例如唯讀目錄) 就算了，下次再解析一次
+void save_dataset_cache(const string &cachename, const struct stat &source, const Dataset &data, int pixels) {
+    DatasetCacheHeader h{};
+    memcpy(h.magic, DATASET_CACHE_MAGIC, sizeof h.magic);
+    h.version = DATASET_CACHE_VERSION;
+    h.pixels = pixels;
+    h.rows = data.size();
+    h.source_size = source.st_size;
+    h.source_mtime = mtime_ns(source);
+
+    vector<uint8_t> labels(data.labels.begin(), data.labels.end());
+    string tmp = cachename + ".tmp";
+    ofstream out(tmp, ios::binary);
+    out.write((const char *)&h, sizeof h);
+    out.write((const char *)labels.data(), labels.size());
+    for (int r = 0; r < data.size(); ++r) out.write((const char *)data.image(r), pixels);
+    out.close();
+    if (!out || rename(tmp.c_str(), cachename.c_str()) != 0) remove(tmp.c_str());
+}
+
+// CSV 的欄位配置，由表頭決定：欄數，以及哪一欄是 label (表頭裡叫 label 的那欄，沒有就是最後一欄)
+struct CsvLayout {
+    int cols = 0;
+    int label_col = -1;
+};
+
+// 解析 [p, end) 的每一行 (p 必須在行首)，有效的列依序寫進 data 的第 row 列之後，回傳寫了幾列
+// line 為第一行的行號；欄數不符或數值不合法的行跳過，訊息放進 errors 由呼叫端依序印出
+int parse_rows(const char *p, const char *end, const CsvLayout &layout, Dataset &data, int row, int line,
+               vector<string> &errors) {
+    int written = 0;
+    for (; p < end; ++line) {
+        const char *begin = p, *eol = (const char *)memchr(p, '\n', end - p);
+        if (!eol) eol = end;
+        uint8_t *image = data.images.row(row + written);
+        int col = 0, label = 0, px = 0;
+        bool ok = true;
+        while (ok) {
+            uint8_t v = 0;
+            auto [q, ec] = from_chars(p, eol, v);
+            ok = ec == errc();
+            if (col == layout.label_col) label = v;
+            else if (px < pixel) image[px++] = v;
+            col++;
+            p = q;
+            if (p < eol && *p == ',') p++;
+            else break;
+        }
+        if (p < eol && *p == '\r') p++;
+
+        int cols = begin == eol ? 0 : count(begin, eol, ',') + 1;
+        if (cols != layout.cols)
+            errors.push_back("Line " + to_string(line) + ": Expected " + to_string(layout.cols) + " columns, but got " + to_string(cols));
+        else if (!ok || p != eol || label >= num)
+            errors.push_back("Line " + to_string(line) + ": Invalid value (pixels must be 0~255, label 0~" + to_string(num - 1) + ")");
+        else {
+            data.labels[row + written] = label;
+            written++;
+        }
+        p = eol + 1;
     }
-    return tokens;
+    return written;
 }
 
-// 讀取 MNIST CSV
-void load_csv(const string& filename, vector<vector<double>>& images, vector<int>& labels) {
-    ifstream file(filename);
-    string line;
-    int line_num = 0;
+// 讀取 MNIST CSV (第一行是表頭)；use_cache 時讀寫旁邊的 filename + ".bin"
+// 檔案依行切成 hardware_concurrency 段 (每段至少 1MB)：先平行數每段的行數決定各段寫入的起點，再平行解析
+void load_csv(const string& filename, Dataset& data, bool use_cache = true) {
+    data = Dataset();
+    MappedFile file(filename);
+    if (!file.data) {
+        cerr << "Cannot open " << filename << endl;
+        return;
+    }
+    string cachename = filename + ".bin";
+    if (use_cache && load_dataset_cache(cachename, file.info, data)) return;
+
+    // 表頭
+    const char *p = file.data, *end = file.data + file.size;
+    const char *eol = (const char *)memchr(p, '\n', end - p);
+    string_view header(p, (eol ? eol : end) - p);
+    if (!header.empty() && header.back() == '\r') header.remove_suffix(1);
+    CsvLayout layout;
+    for (size_t start = 0;; ++layout.cols) {
+        size_t comma = header.find(',', start);
+        if (header.substr(start, comma - start) == "label") layout.label_col = layout.cols;
+        if (comma == string_view::npos) break;
+        start = comma + 1;
+    }
+    layout.cols++;
+    if (layout.label_col < 0) layout.label_col = layout.cols - 1;
+    if (layout.cols < 2 || layout.cols - 1 > pixel) {
+        cerr << filename << ": Expected 2~" << pixel + 1 << " columns in the header, but got " << layout.cols << endl;
+        return;
+    }
+    p = eol ? eol + 1 : end;
+
+    // 切段，每段的結尾都在換行之後
+    int T = max(1, min((int)thread::hardware_concurrency(), (int)((end - p) >> 20)));
+    vector<const char *> cut(T + 1, end);
+    cut[0] = p;
+    for (int t = 1; t < T; ++t) {
+        const char *q = max(cut[t - 1], p + (end - p) * t / T);
+        const char *nl = (const char *)memchr(q, '\n', end - q);
+        cut[t] = nl ? nl + 1 : end;
+    }
+
+    // 第一趟：每段的行數 (最後一行可能沒有換行)，前綴和就是各段的起始列與行號
+    vector<int> lines(T + 1, 0);
+    run_threads(T, [&](int t) {
+        lines[t + 1] = count(cut[t], cut[t + 1], '\n') + (cut[t + 1] > cut[t] && cut[t + 1][-1] != '\n');
+    });
+    for (int t = 0; t < T; ++t) lines[t + 1] += lines[t];
+    data.images.resize(lines[T]);
+    data.labels.resize(lines[T]);
 
-    while (getline(file, line)) {
-        if (line_num == 0) { 
-        line_num++;
-        continue;
+    // 第二趟：解析 (第一行是表頭，所以資料從第 2 行開始)
+    vector<int> written(T);
+    vector<vector<string>> errors(T);
+    run_threads(T, [&](int t) { written[t] = parse_rows(cut[t], cut[t + 1], layout, data, lines[t], lines[t] + 2, errors[t]); });
+
+    // 有跳過的行時，把後面各段往前搬成連續的
+    int rows = 0;
+    for (int t = 0; t < T; ++t) {
+        for (const string &e : errors[t]) cerr << e << endl;
+        if (rows != lines[t]) {
+            memmove(data.images.row(rows), data.images.row(lines[t]), (size_t)written[t] * data.images.stride);
+            copy_n(data.labels.begin() + lines[t], written[t], data.labels.begin() + rows);
         }
-        line_num++;
-        vector<string> tokens = split(line, ',');
+        rows += written[t];
+    }
+    data.images.resize(rows);
+    data.labels.resize(rows);
+
+    if (use_cache) save_dataset_cache(cachename, file.info, data, layout.cols - 1);
+}
+
+// ---- kernel：logits 與梯度更新，各有 scalar、AVX2、AVX-512 三個版本，執行時依 CPU 選擇 ----
+// 兩者都一次處理全部 num 個類別：每 8 / 16 個像素只轉成 float 一次，再與 num 列權重各做一次 FMA
+// 小批次訓練另有三個 kernel：gemm_logits (X · Wᵀ)、softmax_batch、gemm_update (Wᵀ += Xᵀ · G)
+// 批次的 logits / 梯度以類別為主存放：C[n * ldc + m] 為第 m 筆的第 n 類，同一類別的整個 batch 連續
+
+// out[j] = Σ_i x[i] * W[j][i]
+void logits_scalar(const uint8_t *x, const float *W, int stride, float *out) {
+    for (int j = 0; j < num; ++j) {
+        const float *w = W + (size_t)j * stride;
+        float sum = 0;
+        for (int i = 0; i < pixel; ++i) sum += x[i] * w[i];
+        out[j] = sum;
+    }
+}
+
+// W[j][i] += a[j] * x[i]
+void update_scalar(const uint8_t *x, const float *a, float *W, int stride) {
+    for (int j = 0; j < num; ++j) {
+        float *w = W + (size_t)j * stride;
+        for (int i = 0; i < pixel; ++i) w[i] += a[j] * x[i];
+    }
+}
 
-        if (tokens.size() != 781) {
-            cerr << "Line " << line_num << ": Expected 781 columns, but got " << tokens.size() << endl;
-            continue;
+// C[n][m] = Σ_k X[m][k] * W[n][k]，m < rows
+void gemm_logits_scalar(const uint8_t *X, int ldx, int rows, const float *W, int ldw, float *C, int ldc) {
+    float out[num];
+    for (int m = 0; m < rows; ++m) {
+        logits_scalar(X + (size_t)m * ldx, W, ldw, out);
+        for (int n = 0; n < num; ++n) C[(size_t)n * ldc + m] = out[n];
+    }
+}
+
+// 就地把 C (X · Wᵀ) 換成機率：z = C / 255 + b[n]，每一筆 (每一欄) 做 softmax
+// lse[m] = log Σ_n exp(z[n]) (log-sum-exp)，loss 用 lse - z_y 算，不必對可能被 flush 成 0 的機率取 log
+void softmax_batch_scalar(float *C, int ldc, int rows, const float *b, float *lse) {
+    for (int m = 0; m < rows; ++m) {
+        float z[num], maxz = -INFINITY, sum = 0;
+        for (int n = 0; n < num; ++n) maxz = max(maxz, z[n] = C[(size_t)n * ldc + m] / 255.0f + b[n]);
+        for (int n = 0; n < num; ++n) sum += z[n] = exp(z[n] - maxz);
+        for (int n = 0; n < num; ++n) C[(size_t)n * ldc + m] = z[n] / sum;
+        lse[m] = maxz + log(sum);
+    }
+}
+
+// W[n][k] += Σ_m G[n][m] * X[m][k]
+void gemm_update_scalar(const uint8_t *X, int ldx, int rows, const float *G, int ldg, float *W, int ldw) {
+    for (int m = 0; m < rows; ++m) {
+        float a[num];
+        for (int n = 0; n < num; ++n) a[n] = G[(size_t)n * ldg + m];
+        update_scalar(X + (size_t)m * ldx, a, W, ldw);
+    }
+}
+
+const int GEMM_MC = 64;  // gemm_update 每次處理的列數：64 張影像 (約 53KB) 在掃過所有像素的期間留在 L1 / L2
+
+__attribute__((target("avx2,fma")))
+inline __m256 load_u8x8(const uint8_t *x) {
+    return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)x)));
+}
+
+__attribute__((target("avx2,fma")))
+inline float hsum256(__m256 acc) {
+    __m128 v = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    v = _mm_add_ss(v, _mm_movehdup_ps(v));
+    return _mm_cvtss_f32(v);
+}
+
+// exp：n = round(x / ln2)，r = x - n ln2，exp(r) 用 Cephes expf 的多項式，再乘上 2^n (x 先夾在 -87 以上)
+__attribute__((target("avx2,fma")))
+inline __m256 exp256(__m256 x) {
+    x = _mm256_max_ps(x, _mm256_set1_ps(-87.0f));
+    __m256 n = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(1.44269504f)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256 r = _mm256_fnmadd_ps(n, _mm256_set1_ps(0.693359375f), x);
+    r = _mm256_fnmadd_ps(n, _mm256_set1_ps(-2.12194440e-4f), r);
+    __m256 p = _mm256_set1_ps(1.9875691500e-4f);
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.3981999507e-3f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(8.3334519073e-3f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(4.1665795894e-2f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.6666665459e-1f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(5.0000001201e-1f));
+    p = _mm256_fmadd_ps(p, _mm256_mul_ps(r, r), _mm256_add_ps(r, _mm256_set1_ps(1.0f)));
+    __m256i e = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+    return _mm256_mul_ps(p, _mm256_castsi256_ps(e));
+}
+
+__attribute__((target("avx2,fma")))
+void logits_avx2(const uint8_t *x, const float *W, int stride, float *out) {
+    __m256 acc[num];
+    #pragma GCC unroll 10
+    for (int j = 0; j < num; ++j) acc[j] = _mm256_setzero_ps();
+    for (int i = 0; i < pixel; i += 8) {
+        __m256 xv = load_u8x8(x + i);
+        #pragma GCC unroll 10
+        for (int j = 0; j < num; ++j) acc[j] = _mm256_fmadd_ps(xv, _mm256_load_ps(W + (size_t)j * stride + i), acc[j]);
+    }
+    #pragma GCC unroll 10
+    for (int j = 0; j < num; ++j) out[j] = hsum256(acc[j]);
+}
+
+__attribute__((target("avx2,fma")))
+void update_avx2(const uint8_t *x, const float *a, float *W, int stride) {
+    __m256 av[num];
+    #pragma GCC unroll 10
+    for (int j = 0; j < num; ++j) av[j] = _mm256_set1_ps(a[j]);
+    for (int i = 0; i < pixel; i += 8) {
+        __m256 xv = load_u8x8(x + i);
+        #pragma GCC unroll 10
+        for (int j = 0; j < num; ++j) {
+            float *w = W + (size_t)j * stride + i;
+            _mm256_store_ps(w, _mm256_fmadd_ps(av[j], xv, _mm256_load_ps(w)));
         }
+    }
+}
+
+// AVX2 只有 16 個暫存器，一次一列 (10 個累加器) 就用完了，所以逐列呼叫 logits_avx2
+__attribute__((target("avx2,fma")))
+void gemm_logits_avx2(const uint8_t *X, int ldx, int rows, const float *W, int ldw, float *C, int ldc) {
+    float out[num];
+    for (int m = 0; m < rows; ++m) {
+        logits_avx2(X + (size_t)m * ldx, W, ldw, out);
+        for (int n = 0; n < num; ++n) C[(size_t)n * ldc + m] = out[n];
+    }
+}
 
-        vector<double> image(pixel, 0.0);
+// 一次 8 筆：每個類別一個向量，沿著 batch 做 max、exp、加總與相除 (ldc 是 16 的倍數，最後不滿 8 筆的多算幾欄無妨)
+__attribute__((target("avx2,fma")))
+void softmax_batch_avx2(float *C, int ldc, int rows, const float *b, float *lse) {
+    const __m256 scale = _mm256_set1_ps(1 / 255.0f);
+    for (int m = 0; m < rows; m += 8) {
+        __m256 z[num], maxz = _mm256_set1_ps(-INFINITY), sum = _mm256_setzero_ps();
+        #pragma GCC unroll 10
+        for (int n = 0; n < num; ++n) {
+            z[n] = _mm256_fmadd_ps(_mm256_load_ps(C + (size_t)n * ldc + m), scale, _mm256_set1_ps(b[n]));
+            maxz = _mm256_max_ps(maxz, z[n]);
+        }
+        #pragma GCC unroll 10
+        for (int n = 0; n < num; ++n) sum = _mm256_add_ps(sum, z[n] = exp256(_mm256_sub_ps(z[n], maxz)));
+        #pragma GCC unroll 10
+        for (int n = 0; n < num; ++n) _mm256_store_ps(C + (size_t)n * ldc + m, _mm256_div_ps(z[n], sum));
+        alignas(32) float mx[8], sm[8];
+        _mm256_store_ps(mx, maxz);
+        _mm256_store_ps(sm, sum);
+        for (int l = 0; l < 8 && m + l < rows; ++l) lse[m + l] = mx[l] + log(sm[l]);
+    }
+}
 
-        for (int i = 0; i < 780; ++i) {
-            image[i] = stod(tokens[i]) / 255.0;
+// 暫存器分塊：8 個像素 x num 個類別的累加器，沿著 batch 的 GEMM_MC 列累加後才寫回 W
+__attribute__((target("avx2,fma")))
+void gemm_update_avx2(const uint8_t *X, int ldx, int rows, const float *G, int ldg, float *W, int ldw) {
+    for (int m0 = 0; m0 < rows; m0 += GEMM_MC) {
+        int m1 = min(rows, m0 + GEMM_MC);
+        for (int k = 0; k < pixel; k += 8) {
+            __m256 acc[num];
+            #pragma GCC unroll 10
+            for (int n = 0; n < num; ++n) acc[n] = _mm256_setzero_ps();
+            for (int m = m0; m < m1; ++m) {
+                __m256 xv = load_u8x8(X + (size_t)m * ldx + k);
+                #pragma GCC unroll 10
+                for (int n = 0; n < num; ++n) acc[n] = _mm256_fmadd_ps(_mm256_broadcast_ss(G + (size_t)n * ldg + m), xv, acc[n]);
+            }
+            #pragma GCC unroll 10
+            for (int n = 0; n < num; ++n) {
+                float *w = W + (size_t)n * ldw + k;
+                _mm256_store_ps(w, _mm256_add_ps(_mm256_load_ps(w), acc[n]));
+            }
         }
-        for (int i = 780; i < 784; ++i) {
-            image[i] = 0.0; // padding
+    }
+}
+
+__attribute__((target("avx512f")))
+inline __m512 load_u8x16(const uint8_t *x) {
+    // 用 maskz 版本：GCC 12 的非遮罩版本內部用 _mm512_undefined，會有誤報的 -Wuninitialized
+    return _mm512_maskz_cvtepi32_ps(0xFFFF, _mm512_maskz_cvtepu8_epi32(0xFFFF, _mm_load_si128((const __m128i *)x)));
+}
+
+// 水平加總直接存下來相加 (GCC 12 的 _mm512_reduce_add_ps 有誤報的 -Wuninitialized)
+__attribute__((target("avx512f")))
+inline float hsum512(__m512 acc) {
+    alignas(64) float lane[16];
+    _mm512_store_ps(lane, acc);
+    float sum = 0;
+    for (float v : lane) sum += v;
+    return sum;
+}
+
+// 同 exp256；2^n 用 scalef
+__attribute__((target("avx512f")))
+inline __m512 exp512(__m512 x) {
+    x = _mm512_maskz_max_ps(0xFFFF, x, _mm512_set1_ps(-87.0f));
+    __m512 n = _mm512_maskz_roundscale_ps(0xFFFF, _mm512_mul_ps(x, _mm512_set1_ps(1.44269504f)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m512 r = _mm512_fnmadd_ps(n, _mm512_set1_ps(0.693359375f), x);
+    r = _mm512_fnmadd_ps(n, _mm512_set1_ps(-2.12194440e-4f), r);
+    __m512 p = _mm512_set1_ps(1.9875691500e-4f);
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(1.3981999507e-3f));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(8.3334519073e-3f));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(4.1665795894e-2f));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(1.6666665459e-1f));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(5.0000001201e-1f));
+    p = _mm512_fmadd_ps(p, _mm512_mul_ps(r, r), _mm512_add_ps(r, _mm512_set1_ps(1.0f)));
+    return _mm512_maskz_scalef_ps(0xFFFF, p, n);
+}
+
+__attribute__((target("avx512f")))
+void logits_avx512(const uint8_t *x, const float *W, int stride, float *out) {
+    __m512 acc[num];
+    #pragma GCC unroll 10
+    for (int j = 0; j < num; ++j) acc[j] = _mm512_setzero_ps();
+    for (int i = 0; i < pixel; i += 16) {
+        __m512 xv = load_u8x16(x + i);
+        #pragma GCC unroll 10
+        for (int j = 0; j < num; ++j) acc[j] = _mm512_fmadd_ps(xv, _mm512_load_ps(W + (size_t)j * stride + i), acc[j]);
+    }
+    #pragma GCC unroll 10
+    for (int j = 0; j < num; ++j) out[j] = hsum512(acc[j]);
+}
+
+__attribute__((target("avx512f")))
+void update_avx512(const uint8_t *x, const float *a, float *W, int stride) {
+    __m512 av[num];
+    #pragma GCC unroll 10
+    for (int j = 0; j < num; ++j) av[j] = _mm512_set1_ps(a[j]);
+    for (int i = 0; i < pixel; i += 16) {
+        __m512 xv = load_u8x16(x + i);
+        #pragma GCC unroll 10
+        for (int j = 0; j < num; ++j) {
+            float *w = W + (size_t)j * stride + i;
+            _mm512_store_ps(w, _mm512_fmadd_ps(av[j], xv, _mm512_load_ps(w)));
         }
-        int label = stoi(tokens[780]); // 最後一欄是 label
-        images.push_back(image);
-        labels.push_back(label);
-        
     }
 }
 
+// 暫存器分塊：一次 2 列 x num 個類別 (20 個累加器，AVX-512 有 32 個暫存器)，每個權重向量載入一次用兩次
+__attribute__((target("avx512f")))
+void gemm_logits_avx512(const uint8_t *X, int ldx, int rows, const float *W, int ldw, float *C, int ldc) {
+    int m = 0;
+    for (; m + 2 <= rows; m += 2) {
+        const uint8_t *x0 = X + (size_t)m * ldx, *x1 = x0 + ldx;
+        __m512 a0[num], a1[num];
+        #pragma GCC unroll 10
+        for (int n = 0; n < num; ++n) a0[n] = a1[n] = _mm512_setzero_ps();
+        for (int k = 0; k < pixel; k += 16) {
+            __m512 v0 = load_u8x16(x0 + k), v1 = load_u8x16(x1 + k);
+            #pragma GCC unroll 10
+            for (int n = 0; n < num; ++n) {
+                __m512 w = _mm512_load_ps(W + (size_t)n * ldw + k);
+                a0[n] = _mm512_fmadd_ps(v0, w, a0[n]);
+                a1[n] = _mm512_fmadd_ps(v1, w, a1[n]);
+            }
+        }
+        #pragma GCC unroll 10
+        for (int n = 0; n < num; ++n) {
+            C[(size_t)n * ldc + m] = hsum512(a0[n]);
+            C[(size_t)n * ldc + m + 1] = hsum512(a1[n]);
+        }
+    }
+    if (m < rows) {  // 最後單獨的一列
+        float out[num];
+        logits_avx512(X + (size_t)m * ldx, W, ldw, out);
+        for (int n = 0; n < num; ++n) C[(size_t)n * ldc + m] = out[n];
+    }
+}
 
+// 一次 16 筆，同 softmax_batch_avx2
+__attribute__((target("avx512f")))
+void softmax_batch_avx512(float *C, int ldc, int rows, const float *b, float *lse) {
+    const __m512 scale = _mm512_set1_ps(1 / 255.0f);
+    for (int m = 0; m < rows; m += 16) {
+        __m512 z[num], maxz = _mm512_set1_ps(-INFINITY), sum = _mm512_setzero_ps();
+        #pragma GCC unroll 10
+        for (int n = 0; n < num; ++n) {
+            z[n] = _mm512_fmadd_ps(_mm512_load_ps(C + (size_t)n * ldc + m), scale, _mm512_set1_ps(b[n]));
+            maxz = _mm512_maskz_max_ps(0xFFFF, maxz, z[n]);
+        }
+        #pragma GCC unroll 10
+        for (int n = 0; n < num; ++n) sum = _mm512_add_ps(sum, z[n] = exp512(_mm512_sub_ps(z[n], maxz)));
+        #pragma GCC unroll 10
+        for (int n = 0; n < num; ++n) _mm512_store_ps(C + (size_t)n * ldc + m, _mm512_div_ps(z[n], sum));
+        alignas(64) float mx[16], sm[16];
+        _mm512_store_ps(mx, maxz);
+        _mm512_store_ps(sm, sum);
+        for (int l = 0; l < 16 && m + l < rows; ++l) lse[m + l] = mx[l] + log(sm[l]);
+    }
+}
+
+// 暫存器分塊：32 個像素 (兩個向量) x num 個類別 = 20 個累加器，沿著 batch 的 GEMM_MC 列累加後才寫回 W
+__attribute__((target("avx512f")))
+void gemm_update_avx512(const uint8_t *X, int ldx, int rows, const float *G, int ldg, float *W, int ldw) {
+    for (int m0 = 0; m0 < rows; m0 += GEMM_MC) {
+        int m1 = min(rows, m0 + GEMM_MC);
+        for (int k = 0; k < pixel; k += 32) {
+            bool pair = k + 16 < pixel;  // pixel = 784 不是 32 的倍數，最後一段只有 16 個像素
+            __m512 a0[num], a1[num];
+            #pragma GCC unroll 10
+            for (int n = 0; n < num; ++n) a0[n] = a1[n] = _mm512_setzero_ps();
+            for (int m = m0; m < m1; ++m) {
+                const uint8_t *x = X + (size_t)m * ldx + k;
+                __m512 v0 = load_u8x16(x), v1 = pair ? load_u8x16(x + 16) : _mm512_setzero_ps();
+                #pragma GCC unroll 10
+                for (int n = 0; n < num; ++n) {
+                    __m512 g = _mm512_set1_ps(G[(size_t)n * ldg + m]);
+                    a0[n] = _mm512_fmadd_ps(g, v0, a0[n]);
+                    a1[n] = _mm512_fmadd_ps(g, v1, a1[n]);
+                }
+            }
+            #pragma GCC unroll 10
+            for (int n = 0; n < num; ++n) {
+                float *w = W + (size_t)n * ldw + k;
+                _mm512_store_ps(w, _mm512_add_ps(_mm512_load_ps(w), a0[n]));
+                if (pair) _mm512_store_ps(w + 16, _mm512_add_ps(_mm512_load_ps(w + 16), a1[n]));
+            }
+        }
+    }
+}
+
+struct Kernels {
+    const char *name;
+    void (*logits)(const uint8_t *, const float *, int, float *);
+    void (*update)(const uint8_t *, const float *, float *, int);
+    void (*gemm_logits)(const uint8_t *, int, int, const float *, int, float *, int);
+    void (*softmax_batch)(float *, int, int, const float *, float *);
+    void (*gemm_update)(const uint8_t *, int, int, const float *, int, float *, int);
+};
+
+// name 為 scalar、avx2、avx512 或 auto (CPU 支援的最寬的版本)；CPU 不支援指定的版本時往下退：avx512 → avx2 → scalar
+Kernels select_kernels(const string &name) {
+    bool avx512 = __builtin_cpu_supports("avx512f");
+    bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    if ((name == "auto" || name == "avx512") && avx512)
+        return {"avx512", logits_avx512, update_avx512, gemm_logits_avx512, softmax_batch_avx512, gemm_update_avx512};
+    if ((name == "auto" || name == "avx2" || name == "avx512") && avx2)
+        return {"avx2", logits_avx2, update_avx2, gemm_logits_avx2, softmax_batch_avx2, gemm_update_avx2};
+    return {"scalar", logits_scalar, update_scalar, gemm_logits_scalar, softmax_batch_scalar, gemm_update_scalar};
+}
+
+Kernels kernels = select_kernels("auto");  // --kernel= 可改
+
+// 一張影像的 logits (像素在這裡除以 255)
+void compute_logits(const uint8_t *x, const Model& model, float *logits) {
+    kernels.logits(x, model.W.data.data(), model.W.stride, logits);
+    for (int j = 0; j < num; ++j) logits[j] = logits[j] / 255.0f + model.b[j];
+}
 
 // Softmax 計算
-vector<double> softmax(const vector<double>& logits) {
-    vector<double> probs(num);
-    double maxLogit = *max_element(logits.begin(), logits.end());
-    double sum = 0.0;
+void softmax(const float *logits, float *probs) {
+    float maxLogit = *max_element(logits, logits + num);
+    float sum = 0.0f;
     for (int i = 0; i < num; ++i) {
         probs[i] = exp(logits[i] - maxLogit);
         sum += probs[i];
@@ -72,106 +635,547 @@ vector<double> softmax(const vector<double>& logits) {
     for (int i = 0; i < num; ++i) {
         probs[i] /= sum;
     }
-    return probs;
 }
 
 // 推論：預測 label
-int predict(const vector<double>& image, const vector<vector<double>>& weights, const vector<double>& biases) {
-    vector<double> logits(num, 0.0);
+int predict(const uint8_t *image, const Model& model) {
+    float logits[num];
+    compute_logits(image, model, logits);
+    return max_element(logits, logits + num) - logits;
+}
+
+// 一個小批次的前向與梯度：P = softmax(X · Wᵀ / 255 + b)，G = -lr * (P - onehot) / 255 / step，db[j] = Σ_m (P - onehot) / step
+// step 為這次更新平均的總筆數 (單執行緒時就是 rows，sync 時是各執行緒合起來的筆數)，所以 batch 大小不改變步長
+// P、G 為 num x batch 的暫存 (以類別為主：P.row(j)[m] 為第 m 筆屬於 j 的機率)；loss 與答對數累加到 loss、correct
+// loss 以 log-sum-exp 算 (lse - z_y)：FTZ 打開時很小的機率會變成 0，直接取 log 會得到 inf
+void batch_forward(const uint8_t *X, int ldx, int rows, int step, const int *y, const Matrix<float>& W, const float *b,
+                   Matrix<float>& P, Matrix<float>& G, float *db, double& loss, int& correct) {
+    kernels.gemm_logits(X, ldx, rows, W.data.data(), W.stride, P.data.data(), P.stride);
+    thread_local vector<float> zy, lse;  // 每個執行緒一份，只在 batch 變大時重新配置
+    zy.resize(max(zy.size(), (size_t)rows)), lse.resize(zy.size());
+    for (int m = 0; m < rows; ++m) zy[m] = P.row(y[m])[m] / 255.0f + b[y[m]];
+    kernels.softmax_batch(P.data.data(), P.stride, rows, b, lse.data());
+
+    for (int m = 0; m < rows; ++m) {
+        loss += lse[m] - zy[m];
+        int pred = 0;
+        for (int j = 1; j < num; ++j)
+            if (P.row(j)[m] > P.row(pred)[m]) pred = j;
+        if (pred == y[m]) correct++;
+    }
     for (int j = 0; j < num; ++j) {
-        for (int i = 0; i < pixel; ++i) {
-            logits[j] += image[i] * weights[j][i];
+        float sum = 0;
+        for (int m = 0; m < rows; ++m) {
+            float gradient = P.row(j)[m] - (j == y[m] ? 1.0f : 0.0f);
+            G.row(j)[m] = -lr * gradient / 255.0 / step;
+            sum += gradient;
         }
-        logits[j] += biases[j];
+        db[j] = sum / step;
     }
-    return distance(logits.begin(), max_element(logits.begin(), logits.end()));
 }
 
-// 模型訓練
-void train(
-    const vector<vector<double>>& train_images,
-    const vector<int>& train_labels,
-    vector<vector<double>>& weights,
-    vector<double>& biases
-) {
-    for (int epoch = 0; epoch < max_epo; ++epoch) {
+// 大批次的梯度常落在 denormal 範圍 (機率 ~1e-38 再乘 lr / 255)，x86 處理 denormal 會慢上十倍以上，
+// 所以小批次與平行訓練期間打開 flush-to-zero / denormals-are-zero (MXCSR 是每個執行緒各自的)，結束時還原
+struct FlushDenormals {
+    unsigned csr = _mm_getcsr();
+    FlushDenormals() { _mm_setcsr(csr | _MM_FLUSH_ZERO_ON | _MM_DENORMALS_ZERO_ON); }
+    ~FlushDenormals() { _mm_setcsr(csr); }
+};
+
+void print_epoch(int epoch, double total_loss, int correct, int n) {
+    cout << "Epoch " << epoch + 1 << " - Loss: " << total_loss / n
+         << ", Accuracy: " << (double)correct / n * 100 << "%" << endl;
+}
+
+// 訓練設定
+struct TrainOptions {
+    int epochs = max_epo;
+    int batch = 1;              // 每一步的筆數 (hogwild 為每個執行緒每一步)；1 且 mode 為 sgd 時是逐筆 SGD
+    string mode = "sgd";        // sgd (單執行緒)、sync (同步資料平行)、hogwild (無鎖非同步)
+    int threads = 1;            // sync / hogwild 的執行緒數
+    bool verbose = true;        // 印出每個 epoch 的 Loss / Accuracy
+    double samples_per_sec = 0; // 回傳：最後一個 epoch 的吞吐量
+};
+
+// 小批次訓練：每 batch 筆做一次 GEMM 前向、softmax、一次 GEMM 累積梯度，權重只更新一次
+// 梯度取 batch 內的平均，batch 大小只影響速度，不改變每一步的步長
+void train_batch(const Dataset& data, Model& model, TrainOptions& opt) {
+    FlushDenormals ftz;
+    const int batch = opt.batch;
+    Matrix<float> P(num, batch), G(num, batch);
+    for (int epoch = 0; epoch < opt.epochs; ++epoch) {
         double total_loss = 0.0;
         int correct = 0;
+        auto t0 = chrono::steady_clock::now();
 
-        for (size_t n = 0; n < train_images.size(); ++n) {
-            const vector<double>& x = train_images[n];
-            int y = train_labels[n];
+        for (int m0 = 0; m0 < data.size(); m0 += batch) {
+            int rows = min(batch, data.size() - m0);
+            const uint8_t *X = data.image(m0);
+            float db[num];
+            batch_forward(X, data.images.stride, rows, rows, data.labels.data() + m0, model.W, model.b, P, G, db, total_loss, correct);
+            for (int j = 0; j < num; ++j) model.b[j] -= lr * db[j];
 
-            // 計算 logits
-            vector<double> logits(num, 0.0);
+            // 反向：W += Gᵀ · X，整個 batch 只寫一次權重
+            kernels.gemm_update(X, data.images.stride, rows, G.data.data(), G.stride, model.W.data.data(), model.W.stride);
+        }
+
+        opt.samples_per_sec = data.size() / chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+        if (opt.verbose) print_epoch(epoch, total_loss, correct, data.size());
+    }
+}
+
+// 平行訓練的每個 epoch：T 個執行緒各跑 worker(t)，
+// 各執行緒的 loss / 答對數依執行緒順序加總後印出，並記錄吞吐量
+template <class F>
+void run_epochs(const Dataset& data, TrainOptions& opt, vector<double>& loss, vector<int>& correct, F&& worker) {
+    const int T = opt.threads;
+    for (int epoch = 0; epoch < opt.epochs; ++epoch) {
+        fill(loss.begin(), loss.end(), 0.0);
+        fill(correct.begin(), correct.end(), 0);
+        auto t0 = chrono::steady_clock::now();
+        run_threads(T, worker);
+        opt.samples_per_sec = data.size() / chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+
+        double total_loss = 0;
+        int total_correct = 0;
+        for (int t = 0; t < T; ++t) total_loss += loss[t], total_correct += correct[t];
+        if (opt.verbose) {
+            print_epoch(epoch, total_loss, total_correct, data.size());
+            cout << "  " << opt.samples_per_sec << " samples/s on " << T << " threads" << endl;
+        }
+    }
+}
+
+// 同步資料平行：每一步取 opt.batch 筆平分給 T 個執行緒，各自把梯度 (除以這一步的總筆數) 算進自己的 dW / db，
+// 再依固定的樹狀順序 (dW[i] += dW[i + s]，s = 1, 2, 4, ...) 兩兩相加後更新一次權重
+// 一步就是 opt.batch 筆的平均，與 train_batch 只差加法順序，執行緒數只影響速度
+// 歸約時每個執行緒負責一段像素欄，每一欄的加法順序只由 T 決定，所以固定種子與執行緒數時結果可重現
+void train_sync(const Dataset& data, Model& model, TrainOptions& opt) {
+    const int T = opt.threads, step = opt.batch, batch = (step + T - 1) / T;  // batch：每個執行緒分到的筆數
+    vector<Matrix<float>> dW(T, Matrix<float>(num, pixel));
+    vector<array<float, num>> db(T);
+    vector<double> loss(T);
+    vector<int> correct(T);
+    barrier sync(T);
+
+    // 每個執行緒負責的像素欄 [cols[t], cols[t + 1])，切在 16 的倍數上，不同執行緒不共用 cache line
+    vector<int> cols(T + 1);
+    for (int t = 0; t <= T; ++t) cols[t] = min(pixel, (int)((long long)pixel * t / T + 15) / 16 * 16);
+    cols[T] = pixel;
+
+    auto worker = [&](int t) {
+        FlushDenormals ftz;
+        Matrix<float> P(num, batch), G(num, batch);
+        double my_loss = 0;  // 先累加在自己的變數，最後才寫回 (避免相鄰的 loss[t] 互相 false sharing)
+        int my_correct = 0;
+        for (int m0 = 0; m0 < data.size(); m0 += step) {
+            // 各自算梯度 (最後一步可能有執行緒分不到資料，rows = 0)
+            int first = min(data.size(), m0 + t * batch), rows = min(batch, data.size() - first);
+            int step_rows = min(step, data.size() - m0);
+            fill(dW[t].data.begin(), dW[t].data.end(), 0.0f);
+            db[t].fill(0.0f);
+            if (rows > 0) {
+                const uint8_t *X = data.image(first);
+                batch_forward(X, data.images.stride, rows, step_rows, data.labels.data() + first, model.W, model.b, P, G, db[t].data(), my_loss, my_correct);
+                kernels.gemm_update(X, data.images.stride, rows, G.data.data(), G.stride, dW[t].data.data(), dW[t].stride);
+            }
+            sync.arrive_and_wait();
+
+            // 樹狀歸約自己那段欄位，再寫回 W；b 由執行緒 0 以同樣的順序處理
+            for (int s = 1; s < T; s *= 2)
+                for (int i = 0; i + s < T; i += 2 * s)
+                    for (int j = 0; j < num; ++j) {
+                        float *a = dW[i].row(j), *b = dW[i + s].row(j);
+                        for (int k = cols[t]; k < cols[t + 1]; ++k) a[k] += b[k];
+                    }
             for (int j = 0; j < num; ++j) {
-                for (int i = 0; i < pixel; ++i) {
-                    logits[j] += x[i] * weights[j][i];
-                }
-                logits[j] += biases[j];
+                float *w = model.W.row(j), *g = dW[0].row(j);
+                for (int k = cols[t]; k < cols[t + 1]; ++k) w[k] += g[k];
+            }
+            if (t == 0) {
+                for (int s = 1; s < T; s *= 2)
+                    for (int i = 0; i + s < T; i += 2 * s)
+                        for (int j = 0; j < num; ++j) db[i][j] += db[i + s][j];
+                for (int j = 0; j < num; ++j) model.b[j] -= lr * db[0][j];
+            }
+            sync.arrive_and_wait();  // 權重更新完才開始下一步的前向
+        }
+        loss[t] = my_loss, correct[t] = my_correct;
+    };
+
+    run_epochs(data, opt, loss, correct, worker);
+}
+
+// Hogwild!：執行緒輪流取 batch (第 t 個執行緒做第 t、t + T、t + 2T ... 個)，彼此不同步、不加鎖
+// 共用的 W / b 一律用 relaxed 的 atomic_ref 讀寫：每一步先把 W 複製到自己的 Wl 再跑向量化的 kernel，
+// 梯度算進自己的 dW 後逐一加回 W；讀寫之間別的執行緒的更新可能被覆蓋，這正是 Hogwild 接受的代價
+void train_hogwild(const Dataset& data, Model& model, TrainOptions& opt) {
+    const int T = opt.threads, batch = opt.batch;
+    vector<double> loss(T);
+    vector<int> correct(T);
+    const size_t weights = model.W.data.size();
+
+    auto worker = [&](int t) {
+        FlushDenormals ftz;
+        Matrix<float> P(num, batch), G(num, batch), Wl(num, pixel), dW(num, pixel);
+        float bl[num], db[num];
+        double my_loss = 0;
+        int my_correct = 0;
+        for (int m0 = t * batch; m0 < data.size(); m0 += T * batch) {
+            int rows = min(batch, data.size() - m0);
+            const uint8_t *X = data.image(m0);
+            for (size_t k = 0; k < weights; ++k) Wl.data[k] = atomic_ref(model.W.data[k]).load(memory_order_relaxed);
+            for (int j = 0; j < num; ++j) bl[j] = atomic_ref(model.b[j]).load(memory_order_relaxed);
+
+            batch_forward(X, data.images.stride, rows, rows, data.labels.data() + m0, Wl, bl, P, G, db, my_loss, my_correct);
+            fill(dW.data.begin(), dW.data.end(), 0.0f);
+            kernels.gemm_update(X, data.images.stride, rows, G.data.data(), G.stride, dW.data.data(), dW.stride);
+
+            for (size_t k = 0; k < weights; ++k) {
+                atomic_ref w(model.W.data[k]);
+                w.store(w.load(memory_order_relaxed) + dW.data[k], memory_order_relaxed);
+            }
+            for (int j = 0; j < num; ++j) {
+                atomic_ref b(model.b[j]);
+                b.store(b.load(memory_order_relaxed) - lr * db[j], memory_order_relaxed);
             }
+        }
+        loss[t] = my_loss, correct[t] = my_correct;
+    };
+
+    run_epochs(data, opt, loss, correct, worker);
+}
+
+// 模型訓練；mode 為 sgd 且 batch = 1 時為逐筆 SGD (與原本的輸出逐位元相同)，batch > 1 走 train_batch
+void train(const Dataset& data, Model& model, TrainOptions& opt) {
+    if (opt.mode == "sync") return train_sync(data, model, opt);
+    if (opt.mode == "hogwild") return train_hogwild(data, model, opt);
+    if (opt.batch > 1) return train_batch(data, model, opt);
+    for (int epoch = 0; epoch < opt.epochs; ++epoch) {
+        double total_loss = 0.0;
+        int correct = 0;
+        auto t0 = chrono::steady_clock::now();
+
+        for (int n = 0; n < data.size(); ++n) {
+            const uint8_t *x = data.image(n);
+            int y = data.labels[n];
+
+            // 計算 logits
+            float logits[num], probs[num];
+            compute_logits(x, model, logits);
 
             // softmax & loss
-            vector<double> probs = softmax(logits);
+            softmax(logits, probs);
             total_loss -= log(probs[y]);
 
             // Accuracy
-            int pred = distance(probs.begin(), max_element(probs.begin(), probs.end()));
+            int pred = max_element(probs, probs + num) - probs;
             if (pred == y) correct++;
 
-            // 梯度更新
+            // 梯度更新：W[j] -= lr * gradient * x / 255
+            float step[num];
             for (int j = 0; j < num; ++j) {
-                double gradient = probs[j] - (j == y ? 1.0 : 0.0);
-                for (int i = 0; i < pixel; ++i) {
-                    weights[j][i] -= lr * gradient * x[i];
+                float gradient = probs[j] - (j == y ? 1.0f : 0.0f);
+                step[j] = -lr * gradient / 255.0;
+                model.b[j] -= lr * gradient;
+            }
+            kernels.update(x, step, model.W.data.data(), model.W.stride);
+        }
+
+        opt.samples_per_sec = data.size() / chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+        if (opt.verbose) print_epoch(epoch, total_loss, correct, data.size());
+    }
+}
+
+// ---- 批次推論與評估 ----
+
+// 批次推論：X 為連續的 rows 張影像 (每列 ldx bytes)，預測結果寫進呼叫端配置好的 pred[rows]
+// 切成 threads 段，每段每次 64 張用 gemm_logits 算 logits，結果與逐張 predict 相同
+void predict_batch(const uint8_t *X, int ldx, int rows, const Model& model, int *pred, int threads) {
+    const int tile = 64;
+    run_threads(threads, [&](int t) {
+        int begin = (long long)rows * t / threads, end = (long long)rows * (t + 1) / threads;
+        Matrix<float> C(num, tile);
+        for (int m0 = begin; m0 < end; m0 += tile) {
+            int n = min(tile, end - m0);
+            kernels.gemm_logits(X + (size_t)m0 * ldx, ldx, n, model.W.data.data(), model.W.stride, C.data.data(), C.stride);
+            for (int m = 0; m < n; ++m) {
+                int best = 0;
+                float best_z = C.row(0)[m] / 255.0f + model.b[0];
+                for (int j = 1; j < num; ++j) {
+                    float z = C.row(j)[m] / 255.0f + model.b[j];
+                    if (z > best_z) best = j, best_z = z;
                 }
-                biases[j] -= lr * gradient;
+                pred[m0 + m] = best;
             }
         }
+    });
+}
+
+void predict_batch(const Dataset& data, const Model& model, int *pred, int threads) {
+    predict_batch(data.image(0), data.images.stride, data.size(), model, pred, threads);
+}
 
-        cout << "Epoch " << epoch + 1 << " - Loss: " << total_loss / train_images.size()
-             << ", Accuracy: " << (double)correct / train_images.size() * 100 << "%" << endl;
+// 評估結果：confusion[真實][預測]，以及由它算出的 accuracy、每個類別的 precision / recall / F1 與 macro-F1
+struct Evaluation {
+    long long confusion[num][num] = {};
+    double accuracy = 0, macro_f1 = 0;
+    double precision[num] = {}, recall[num] = {}, f1[num] = {};
+};
+
+// 一趟平行掃過所有預測建出 confusion matrix (每個執行緒先累加自己的一份再合併)，其他指標都從它推出
+// 沒出現過的類別 precision / recall 記為 0，macro-F1 仍除以 num (與原本的 compute_macro_f1 相同)
+Evaluation evaluate(const int *labels, const int *pred, int n, int threads) {
+    vector<array<array<long long, num>, num>> local(threads);
+    run_threads(threads, [&](int t) {
+        auto &c = local[t];
+        c = {};
+        for (int i = (long long)n * t / threads, end = (long long)n * (t + 1) / threads; i < end; ++i) c[labels[i]][pred[i]]++;
+    });
+
+    Evaluation e;
+    for (auto &c : local)
+        for (int y = 0; y < num; ++y)
+            for (int p = 0; p < num; ++p) e.confusion[y][p] += c[y][p];
+
+    long long correct = 0;
+    for (int c = 0; c < num; ++c) {
+        long long TP = e.confusion[c][c], actual = 0, predicted = 0;
+        for (int k = 0; k < num; ++k) actual += e.confusion[c][k], predicted += e.confusion[k][c];
+        correct += TP;
+        e.precision[c] = predicted == 0 ? 0 : (double)TP / predicted;
+        e.recall[c] = actual == 0 ? 0 : (double)TP / actual;
+        double sum = e.precision[c] + e.recall[c];
+        e.f1[c] = sum == 0 ? 0 : 2 * e.precision[c] * e.recall[c] / sum;
+        e.macro_f1 += e.f1[c];
     }
+    e.macro_f1 /= num;
+    e.accuracy = n == 0 ? 0 : (double)correct / n;
+    return e;
 }
 
-// 預測結果儲存到 CSV
+// 預測結果儲存到 CSV：數字用 to_chars 寫進 64KB 的緩衝區，滿了才整塊寫出
 void save_predictions(const string& filename, const vector<int>& predictions) {
-    ofstream out(filename);
+    ofstream out(filename, ios::binary);
+    vector<char> buf(1 << 16);
+    size_t len = 0;
     for (int pred : predictions) {
-        out << pred << '\n';
+        if (buf.size() - len < 16) {
+            out.write(buf.data(), len);
+            len = 0;
+        }
+        len = to_chars(buf.data() + len, buf.data() + buf.size(), pred).ptr - buf.data();
+        buf[len++] = '\n';
     }
+    out.write(buf.data(), len);
 }
 
-// 計算 Macro F1-score
-double compute_macro_f1(const vector<int>& true_labels, const vector<int>& pred_labels) {
-    int m = num;
-    double macro_f1 = 0.0;
+// 基準測試：先跑 warmup 次不計時，再計時 reps 次，回報中位數、p95 與吞吐量 (work / 中位數)
+struct BenchResult {
+    string name;
+    string unit;        // 吞吐量單位，例如 nodes/s
+    double work;        // 每次執行的工作量
+    vector<double> secs;
+    double median = 0, p95 = 0;
+};
 
-    for (int c = 0; c < m; ++c) {
-        int TP = 0, FP = 0, FN = 0;
-        for (size_t i = 0; i < true_labels.size(); ++i) {
-            if (pred_labels[i] == c && true_labels[i] == c) TP++;
-            else if (pred_labels[i] == c && true_labels[i] != c) FP++;
-            else if (pred_labels[i] != c && true_labels[i] == c) FN++;
+template <class F>
+BenchResult run_bench(const string &name, const string &unit, double work, int warmup, int reps, F &&f) {
+    BenchResult r{name, unit, work, {}};
+    for (int i = 0; i < warmup; ++i) f();
+    for (int i = 0; i < reps; ++i) {
+        auto t0 = chrono::steady_clock::now();
+        f();
+        r.secs.push_back(chrono::duration<double>(chrono::steady_clock::now() - t0).count());
+    }
+    vector<double> sorted = r.secs;
+    sort(sorted.begin(), sorted.end());
+    r.median = sorted[sorted.size() / 2];
+    r.p95 = sorted[min(sorted.size() - 1, (size_t)ceil(0.95 * sorted.size()) - 1)];
+    cout << name << ": median " << r.median << " s, p95 " << r.p95 << " s, "
+         << (r.median > 0 ? work / r.median : 0) << " " << unit << endl;
+    return r;
+}
+
+// 依副檔名輸出 JSON 或 CSV
+void save_bench(const string &filename, const string &program, const vector<BenchResult> &results) {
+    ofstream out(filename);
+    bool json = filename.size() >= 5 && filename.compare(filename.size() - 5, 5, ".json") == 0;
+    if (json) {
+        out << "{\"program\": \"" << program << "\", \"results\": [\n";
+        for (size_t i = 0; i < results.size(); ++i) {
+            const BenchResult &r = results[i];
+            out << "  {\"name\": \"" << r.name << "\", \"reps\": " << r.secs.size() << ", \"median_s\": " << r.median
+                << ", \"p95_s\": " << r.p95 << ", \"throughput\": " << (r.median > 0 ? r.work / r.median : 0)
+                << ", \"unit\": \"" << r.unit << "\", \"samples_s\": [";
+            for (size_t k = 0; k < r.secs.size(); ++k) out << (k ? ", " : "") << r.secs[k];
+            out << "]}" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        out << "]}\n";
+    } else {
+        out << "program,name,reps,median_s,p95_s,throughput,unit\n";
+        for (const BenchResult &r : results) {
+            out << program << "," << r.name << "," << r.secs.size() << "," << r.median << "," << r.p95 << ","
+                << (r.median > 0 ? r.work / r.median : 0) << "," << r.unit << "\n";
         }
+    }
+}
 
-        double precision = (TP + FP == 0) ? 0 : (double)TP / (TP + FP);
-        double recall = (TP + FN == 0) ? 0 : (double)TP / (TP + FN);
-        double f1 = (precision + recall == 0) ? 0 : 2 * precision * recall / (precision + recall);
+// 解析逗號分隔的整數清單，例如 --bench-sizes=50,100,200
+vector<int> parse_list(const string &s) {
+    vector<int> v;
+    stringstream ss(s);
+    string token;
+    while (getline(ss, token, ',')) v.push_back(stoi(token));
+    return v;
+}
 
-        macro_f1 += f1;
+// 隨機產生 n 筆與 MNIST CSV 相同格式的資料 (表頭 + 780 個像素 + label)
+void generate_csv(const string& filename, int n, unsigned seed) {
+    default_random_engine engine{seed};
+    uniform_int_distribution<int> px(0, 255), digit(0, num - 1);
+    ofstream out(filename);
+    for (int i = 0; i < 780; ++i) out << "pixel" << i << ",";
+    out << "label\n";
+    for (int r = 0; r < n; ++r) {
+        for (int i = 0; i < 780; ++i) out << px(engine) << ",";
+        out << digit(engine) << '\n';
     }
+}
 
-    return macro_f1 / m;
+// 對每個資料量 n 量測 softmax、load_csv (解析與讀快取)，每個 kernel 版本的 predict 與一個 epoch 的 train (逐筆與 batch = 64)，
+// 以及在 threads 中每個執行緒數下的批次推論與 sync / hogwild 平行訓練的一個 epoch，還有評估與寫出預測
+vector<BenchResult> run_benchmarks(const vector<int>& sizes, const vector<int>& threads, int warmup, int reps) {
+    vector<BenchResult> results;
+    volatile double sink = 0;  // 寫入 volatile，避免結果沒被用到而被編譯器省略
+
+    default_random_engine engine{42};
+    normal_distribution<double> dist(0.0, 0.01);
+    Model model;
+    for (int j = 0; j < num; ++j)
+        for (int i = 0; i < pixel; ++i) model.W.row(j)[i] = dist(engine);
+
+    float logits[num], probs[num];
+    for (float& l : logits) l = dist(engine) * 100;
+    const int calls = 100000;
+    results.push_back(run_bench("softmax", "evals/s", calls, warmup, reps, [&] {
+        for (int i = 0; i < calls; ++i) {
+            softmax(logits, probs);
+            sink = sink + probs[0];
+        }
+    }));
+
+    for (int n : sizes) {
+        string tag = "/n=" + to_string(n);
+        string file = "bench_mnist_n=" + to_string(n) + ".csv";
+        generate_csv(file, n, n);
+
+        Dataset data;
+        results.push_back(run_bench("load_csv" + tag, "samples/s", n, warmup, reps, [&] { load_csv(file, data, false); }));
+        load_csv(file, data);  // 寫出快取
+        results.push_back(run_bench("load_csv_cache" + tag, "samples/s", n, warmup, reps, [&] { load_csv(file, data); }));
+        remove(file.c_str());
+        remove((file + ".bin").c_str());
+
+        // 每個 kernel 版本各量一次，CPU 不支援的版本 (select_kernels 退回別的版本) 直接跳過
+        Kernels chosen = kernels;
+        for (string name : {"scalar", "avx2", "avx512"}) {
+            kernels = select_kernels(name);
+            if (kernels.name != name) continue;
+            results.push_back(run_bench("predict_" + name + tag, "samples/s", n, warmup, reps, [&] {
+                for (int i = 0; i < data.size(); ++i) sink = sink + predict(data.image(i), model);
+            }));
+            for (int batch : {1, 64}) {
+                string label = batch == 1 ? "train_epoch_" : "train_epoch_batch64_";
+                results.push_back(run_bench(label + name + tag, "samples/s", n, warmup, reps, [&] {
+                    Model m = model;
+                    TrainOptions opt;
+                    opt.epochs = 1, opt.batch = batch, opt.verbose = false;
+                    train(data, m, opt);
+                }));
+            }
+        }
+        kernels = chosen;
+
+        // 批次推論在各執行緒數下的吞吐量，以及一趟的評估與寫出預測
+        vector<int> pred(n);
+        for (int T : threads)
+            results.push_back(run_bench("predict_batch_t=" + to_string(T) + tag, "samples/s", n, warmup, reps, [&] {
+                predict_batch(data, model, pred.data(), T);
+                sink = sink + pred[0];
+            }));
+        results.push_back(run_bench("evaluate" + tag, "samples/s", n, warmup, reps, [&] {
+            sink = sink + evaluate(data.labels.data(), pred.data(), n, threads.back()).macro_f1;
+        }));
+        string pred_file = "bench_predictions_n=" + to_string(n) + ".csv";
+        results.push_back(run_bench("save_predictions" + tag, "samples/s", n, warmup, reps, [&] { save_predictions(pred_file, pred); }));
+        remove(pred_file.c_str());
+
+        // 平行訓練 (batch 與 main 的預設相同：sync 每步 256 筆，hogwild 每個執行緒 64 筆) 在各執行緒數下的吞吐量，與擴展效率 = 吞吐量 / (執行緒數 x 最少執行緒時每執行緒的吞吐量)
+        for (string mode : {"sync", "hogwild"}) {
+            double base = 0;
+            for (int T : threads) {
+                BenchResult r = run_bench("train_epoch_" + mode + "_t=" + to_string(T) + tag, "samples/s", n, warmup, reps, [&] {
+                    Model m = model;
+                    TrainOptions opt;
+                    opt.epochs = 1, opt.batch = mode == "sync" ? 256 : 64, opt.mode = mode, opt.threads = T, opt.verbose = false;
+                    train(data, m, opt);
+                });
+                double per_thread = r.median > 0 ? n / r.median / T : 0;
+                if (base == 0) base = per_thread;
+                cout << "  scaling efficiency: " << (base > 0 ? per_thread / base * 100 : 0) << "%" << endl;
+                results.push_back(r);
+            }
+        }
+    }
+    return results;
 }
 
 // 主程式
-int main() {
-    vector<vector<double>> train_images, test_images;
-    vector<int> train_labels, test_labels;
+int main(int argc, char* argv[]) {
+    bool bench = false;                      // 跑基準測試而不是訓練
+    vector<int> bench_sizes = {1000, 10000};
+    int bench_warmup = 1, bench_reps = 5;
+    string bench_out = "bench_linear.json";  // .json 或 .csv
+    vector<int> bench_threads = {1};         // 平行訓練量測的執行緒數，預設 1 與全部核心
+    if (thread::hardware_concurrency() > 1) bench_threads.push_back(thread::hardware_concurrency());
+    TrainOptions opt;
+    opt.threads = max(1u, thread::hardware_concurrency());
+    bool use_cache = true;                   // 讀寫 mnist_*.csv.bin 快取
+    string kernel_name = "auto";
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--bench") bench = true;
+        else if (arg.rfind("--bench-sizes=", 0) == 0) bench_sizes = parse_list(arg.substr(14));
+        else if (arg.rfind("--bench-warmup=", 0) == 0) bench_warmup = max(0, stoi(arg.substr(15)));
+        else if (arg.rfind("--bench-reps=", 0) == 0) bench_reps = max(1, stoi(arg.substr(13)));
+        else if (arg.rfind("--bench-out=", 0) == 0) bench_out = arg.substr(12);
+        else if (arg.rfind("--bench-threads=", 0) == 0) bench_threads = parse_list(arg.substr(16));
+        else if (arg.rfind("--batch=", 0) == 0) opt.batch = max(1, stoi(arg.substr(8)));
+        else if (arg.rfind("--parallel=", 0) == 0) opt.mode = arg.substr(11);  // sgd、sync、hogwild
+        else if (arg.rfind("--threads=", 0) == 0) opt.threads = max(1, stoi(arg.substr(10)));
+        else if (arg == "--no-cache") use_cache = false;
+        else if (arg.rfind("--kernel=", 0) == 0) kernel_name = arg.substr(9);  // scalar、avx2、avx512、auto
+    }
+    if (kernel_name != "scalar" && kernel_name != "avx2" && kernel_name != "avx512" && kernel_name != "auto") {
+        cerr << "Unknown --kernel=" << kernel_name << " (expected scalar, avx2, avx512 or auto)" << endl;
+        return 1;
+    }
+    kernels = select_kernels(kernel_name);
+    if (opt.mode != "sgd" && opt.mode != "sync" && opt.mode != "hogwild") {
+        cerr << "Unknown --parallel=" << opt.mode << " (expected sgd, sync or hogwild)" << endl;
+        return 1;
+    }
+    if (bench) {
+        save_bench(bench_out, "linear", run_benchmarks(bench_sizes, bench_threads, bench_warmup, bench_reps));
+        return 0;
+    }
+
+    Dataset train_data, test_data;
 
-    load_csv("mnist_train.csv", train_images, train_labels);
-    load_csv("mnist_test.csv", test_images, test_labels);
+    load_csv("mnist_train.csv", train_data, use_cache);
+    load_csv("mnist_test.csv", test_data, use_cache);
+    cout << "Kernels: " << kernels.name << endl;
 
     // 初始化 weights & biases
     // 初始化 weights & biases with fixed seed
@@ -179,33 +1183,41 @@ int main() {
     default_random_engine engine{seed};
     normal_distribution<double> dist(0.0, 0.01);
 
-    vector<vector<double>> weights(num, vector<double>(pixel));
-    vector<double> biases(num, 0.0);
+    Model model;
 
     for (int j = 0; j < num; ++j)
         for (int i = 0; i < pixel; ++i)
-            weights[j][i] = dist(engine);
+            model.W.row(j)[i] = dist(engine);
 
 
-    train(train_images, train_labels, weights, biases);
+    if (opt.mode != "sgd") {
+        // 平行訓練一次一筆太細，沒指定 --batch= 時 sync 每一步取 256 筆 (平分給各執行緒)，hogwild 每個執行緒每一步取 64 筆
+        if (opt.batch == 1) opt.batch = opt.mode == "sync" ? 256 : 64;
+        cout << "Training: " << opt.mode << ", " << opt.threads << " threads, batch " << opt.batch
+             << (opt.mode == "sync" ? " per step" : " per thread") << endl;
+    }
+    train(train_data, model, opt);
 
     // 預測
-    vector<int> train_preds, test_preds;
-    for (const auto& image : train_images)
-        train_preds.push_back(predict(image, weights, biases));
-    for (const auto& image : test_images)
-        test_preds.push_back(predict(image, weights, biases));
+    vector<int> train_preds(train_data.size()), test_preds(test_data.size());
+    predict_batch(train_data, model, train_preds.data(), opt.threads);
+    predict_batch(test_data, model, test_preds.data(), opt.threads);
 
     // 儲存預測結果
     save_predictions("result_train.csv", train_preds);
     save_predictions("result_test.csv", test_preds);
 
-    // 計算 Macro F1-score
-    double f1_train = compute_macro_f1(train_labels, train_preds);
-    double f1_test = compute_macro_f1(test_labels, test_preds);
+    // 評估：Macro F1-score、Accuracy，以及測試集每個類別的 precision / recall
+    Evaluation train_eval = evaluate(train_data.labels.data(), train_preds.data(), train_data.size(), opt.threads);
+    Evaluation test_eval = evaluate(test_data.labels.data(), test_preds.data(), test_data.size(), opt.threads);
 
-    cout << "Train Macro F1 Score: " << f1_train << endl;
-    cout << "Test  Macro F1 Score: " << f1_test << endl;
+    cout << "Train Macro F1 Score: " << train_eval.macro_f1 << endl;
+    cout << "Test  Macro F1 Score: " << test_eval.macro_f1 << endl;
+    cout << "Train Accuracy: " << train_eval.accuracy * 100 << "%" << endl;
+    cout << "Test  Accuracy: " << test_eval.accuracy * 100 << "%" << endl;
+    cout << "Test  per class (precision / recall):" << endl;
+    for (int c = 0; c < num; ++c)
+        cout << "  " << c << ": " << test_eval.precision[c] << " / " << test_eval.recall[c] << endl;
 
     return 0;
 }
@@ -6,6 +6,27 @@
 #include <algorithm>
 #include <ctime>
 #include <chrono>
+#include <sstream>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <thread>
+#include <barrier>
+#include <optional>
+#include <deque>
+#include <type_traits>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <charconv>
+#include <cctype>
+#include <string_view>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>     // sysconf()
+#include <immintrin.h>
 
 using namespace std;
 
@@ -19,90 +40,1617 @@ double distance(const city &a, const city &b) {
     return hypot(a.x - b.x, a.y - b.y);
 }
 
+// 距離的種類：EUCLID 為原本 TSP_Dim=N.txt 的浮點數歐氏距離，其餘依 TSPLIB 的定義 (結果是整數)
+// GEO 的座標在讀檔時已經換成緯度、經度 (弳度)
+enum Metric { EUCLID, EUC_2D, ATT, GEO };
+
+double metric_distance(Metric m, double x1, double y1, double x2, double y2) {
+    double dx = x1 - x2, dy = y1 - y2;
+    switch (m) {
+    case EUC_2D:
+        return (int)(sqrt(dx * dx + dy * dy) + 0.5);
+    case ATT: {  // pseudo-Euclidean：無條件進位
+        double r = sqrt((dx * dx + dy * dy) / 10);
+        int t = (int)(r + 0.5);
+        return t < r ? t + 1 : t;
+    }
+    case GEO: {  // 地球半徑 6378.388 km 的大圓距離
+        double q1 = cos(y1 - y2), q2 = cos(x1 - x2), q3 = cos(x1 + x2);
+        return (int)(6378.388 * acos(0.5 * ((1 + q1) * q2 - (1 - q1) * q3)) + 1);
+    }
+    default:
+        return sqrt(dx * dx + dy * dy);
+    }
+}
 
 // 計算一個旅程的總長度
-double cal_length(const vector<city> &cities, const vector<int> &tour) {
+double cal_length(const vector<city> &cities, const vector<int> &tour, Metric metric = EUCLID) {
     double total = 0;
     int n = tour.size();
     for (int i = 0; i < n; ++i) {
-        total += distance(cities[tour[i]], cities[tour[(i + 1) % n]]);
+        const city &a = cities[tour[i]], &b = cities[tour[(i + 1) % n]];
+        total += metric == EUCLID ? distance(a, b) : metric_distance(metric, a.x, a.y, b.x, b.y);
     }
     return total;
 }
 
-// 讀取城市(x, y)座標
-void read_city(const string &filename, vector<city> &cities) {
-    ifstream file(filename);
-    int num_of_city;
-    city city;
-    while (file >> num_of_city >> city.x >> city.y) {
-        cities.push_back(city);
+// SoA 座標：x[]、y[] 各自連續，一次可載入 4 個城市的同一個座標
+struct CitySoA {
+    vector<double> x, y;
+    Metric metric = EUCLID;
+    explicit CitySoA(const vector<city> &cities, Metric m = EUCLID) : metric(m) {
+        for (const city &c : cities) {
+            x.push_back(c.x);
+            y.push_back(c.y);
+        }
     }
-    file.close();
+};
+
+// 不用 hypot (為了避免溢位而較慢)；與 cal_length 的結果可能差在最後一個位元
+double cal_length_soa_scalar(const CitySoA &p, const vector<int> &tour) {
+    double total = 0;
+    int n = tour.size();
+    for (int i = 0; i + 1 < n; ++i) {
+        double dx = p.x[tour[i]] - p.x[tour[i + 1]], dy = p.y[tour[i]] - p.y[tour[i + 1]];
+        total += sqrt(dx * dx + dy * dy);
+    }
+    if (n > 1) {  // 最後一段回到起點
+        double dx = p.x[tour[n - 1]] - p.x[tour[0]], dy = p.y[tour[n - 1]] - p.y[tour[0]];
+        total += sqrt(dx * dx + dy * dy);
+    }
+    return total;
+}
+
+// AVX2：一次算 4 條邊 (sqrt 也是 4 個一起)
+// 座標以純量載入再組成向量；實測比 vgatherdpd 快，因為每個城市的座標只在兩個相鄰向量裡各用一次
+__attribute__((target("avx2")))
+double cal_length_soa_avx2(const CitySoA &p, const vector<int> &tour) {
+    int n = tour.size();
+    const int *t = tour.data();
+    const double *X = p.x.data(), *Y = p.y.data();
+    __m256d sum = _mm256_setzero_pd();
+    int i = 0;
+    for (; i + 4 < n; i += 4) {  // 邊 (i, i+1) ~ (i+3, i+4)
+        int c0 = t[i], c1 = t[i + 1], c2 = t[i + 2], c3 = t[i + 3], c4 = t[i + 4];
+        __m256d dx = _mm256_sub_pd(_mm256_set_pd(X[c3], X[c2], X[c1], X[c0]), _mm256_set_pd(X[c4], X[c3], X[c2], X[c1]));
+        __m256d dy = _mm256_sub_pd(_mm256_set_pd(Y[c3], Y[c2], Y[c1], Y[c0]), _mm256_set_pd(Y[c4], Y[c3], Y[c2], Y[c1]));
+        sum = _mm256_add_pd(sum, _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy))));
+    }
+    alignas(32) double lane[4];
+    _mm256_store_pd(lane, sum);
+    double total = (lane[0] + lane[1]) + (lane[2] + lane[3]);
+    for (; i < n; ++i) {  // 剩下的邊與回到起點的那一段
+        int a = t[i], b = t[(i + 1) % n];
+        double dx = X[a] - X[b], dy = Y[a] - Y[b];
+        total += sqrt(dx * dx + dy * dy);
+    }
+    return total;
+}
+
+// 執行時依 CPU 選擇；回報的最佳長度一律用 cal_length (double + hypot) 重算
+// TSPLIB 的距離 (取整數、GEO) 沒有向量化，逐邊計算
+double cal_length_fast(const CitySoA &p, const vector<int> &tour) {
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    if (p.metric != EUCLID) {
+        double total = 0;
+        int n = tour.size();
+        for (int i = 0; i < n; ++i) {
+            int a = tour[i], b = tour[(i + 1) % n];
+            total += metric_distance(p.metric, p.x[a], p.y[a], p.x[b], p.y[b]);
+        }
+        return total;
+    }
+    return avx2 ? cal_length_soa_avx2(p, tour) : cal_length_soa_scalar(p, tour);
 }
 
+// ---- 讀檔：mmap 後以 from_chars 單次掃描，支援原本的 TSP_Dim=N.txt 與 TSPLIB (NODE_COORD_SECTION) ----
+
+// 唯讀 mmap 整個檔案，離開範圍時自動 munmap (與 DFS.cpp 相同)
+struct MappedFile {
+    const char *data = nullptr;
+    size_t size = 0;
+    struct stat info {};
 
-// 隨機生成最一開始的路徑
-vector<int> rand_generate_tour(int n) {
+    explicit MappedFile(const string &filename) {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        if (fstat(fd, &info) == 0 && info.st_size > 0) {
+            void *p = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                data = (const char *)p;
+                size = info.st_size;
+            }
+        }
+        close(fd);
+    }
+    ~MappedFile() {
+        if (data) munmap((void *)data, size);
+    }
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+};
+
+// 二進位快取的檔頭，後面接著 x[n]、y[n] 兩個 double 陣列 (SoA，原始座標，GEO 尚未換算)
+struct CoordCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t metric;
+    uint64_t n;
+    int64_t source_size;   // 原始檔的大小與修改時間，不符就表示快取已過期
+    int64_t source_mtime;  // 奈秒
+};
+const char COORD_CACHE_MAGIC[8] = "TSPSOA";
+const uint32_t COORD_CACHE_VERSION = 1;
+
+inline int64_t mtime_ns(const struct stat &st) { return (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec; }
+
+bool load_coord_cache(const string &cachename, const struct stat &source, vector<city> &cities, Metric &metric) {
+    MappedFile cache(cachename);
+    if (!cache.data || cache.size < sizeof(CoordCacheHeader)) return false;
+
+    CoordCacheHeader h;
+    memcpy(&h, cache.data, sizeof h);
+    if (memcmp(h.magic, COORD_CACHE_MAGIC, sizeof h.magic) != 0 || h.version != COORD_CACHE_VERSION) return false;
+    if (h.source_size != (int64_t)source.st_size || h.source_mtime != mtime_ns(source)) return false;
+    if (h.metric > GEO || cache.size != sizeof h + 2 * h.n * sizeof(double)) return false;
+
+    const char *x = cache.data + sizeof h, *y = x + h.n * sizeof(double);
+    cities.resize(h.n);
+    for (size_t i = 0; i < h.n; ++i) {
+        memcpy(&cities[i].x, x + i * sizeof(double), sizeof(double));
+        memcpy(&cities[i].y, y + i * sizeof(double), sizeof(double));
+    }
+    metric = (Metric)h.metric;
+    return true;
+}
+
+// 快取先寫到暫存檔再改名；寫不進去 (例如唯讀目錄) 就算了，下次再解析一次
+void save_coord_cache(const string &cachename, const struct stat &source, const vector<city> &cities, Metric metric) {
+    CoordCacheHeader h{};
+    memcpy(h.magic, COORD_CACHE_MAGIC, sizeof h.magic);
+    h.version = COORD_CACHE_VERSION;
+    h.metric = metric;
+    h.n = cities.size();
+    h.source_size = source.st_size;
+    h.source_mtime = mtime_ns(source);
+
+    CitySoA soa(cities);
+    string tmp = cachename + ".tmp";
+    ofstream out(tmp, ios::binary);
+    out.write((const char *)&h, sizeof h);
+    out.write((const char *)soa.x.data(), soa.x.size() * sizeof(double));
+    out.write((const char *)soa.y.data(), soa.y.size() * sizeof(double));
+    out.close();
+    if (!out || rename(tmp.c_str(), cachename.c_str()) != 0) remove(tmp.c_str());
+}
+
+// 跳過空白 (不含換行) 後讀一個數字，p 會移到數字之後；from_chars 不接受 + 號，先自己跳過
+inline bool parse_number(const char *&p, const char *end, double &x) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+    if (p < end && *p == '+') p++;
+    auto [q, ec] = from_chars(p, end, x);
+    if (ec != errc()) return false;
+    p = q;
+    return true;
+}
+
+// 座標區：每行「編號 x y」，遇到不是數字開頭的行 (例如 EOF) 就結束
+// 編號剛好是 1..n 的排列時依編號放，否則照檔案的順序
+void parse_coords(const char *p, const char *end, vector<city> &cities) {
+    vector<int> index;
+    index.reserve(cities.capacity());
+    while (p < end) {
+        const char *eol = (const char *)memchr(p, '\n', end - p);
+        if (!eol) eol = end;
+        double id;
+        city c;
+        if (parse_number(p, eol, id)) {
+            if (!parse_number(p, eol, c.x) || !parse_number(p, eol, c.y)) break;
+            cities.push_back(c);
+            index.push_back(id == (int)id ? (int)id : 0);
+        } else {
+            while (p < eol && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+            if (p < eol) break;  // 不是空行
+        }
+        p = eol + 1;
+    }
+
+    int n = cities.size();
+    vector<char> seen(n + 1, 0);
+    bool permutation = true, identity = true;
+    for (int i = 0; i < n && permutation; ++i) {
+        permutation = index[i] >= 1 && index[i] <= n && !seen[index[i]];
+        if (permutation) seen[index[i]] = 1;
+        identity &= index[i] == i + 1;
+    }
+    if (!permutation) {
+        if (n > 0) cerr << "Warning: city indices are not 1.." << n << ", using file order" << endl;
+    } else if (!identity) {
+        vector<city> ordered(n);
+        for (int i = 0; i < n; ++i) ordered[index[i] - 1] = cities[i];
+        cities = move(ordered);
+    }
+}
+
+// TSPLIB 檔頭：KEY : VALUE 一行一個，只看 DIMENSION 與 EDGE_WEIGHT_TYPE；不支援的距離種類回傳 false
+bool parse_tsplib_header(string_view header, vector<city> &cities, Metric &metric) {
+    metric = EUC_2D;
+    while (!header.empty()) {
+        size_t eol = header.find('\n');
+        string_view line = header.substr(0, eol);
+        header = eol == string_view::npos ? string_view() : header.substr(eol + 1);
+        size_t colon = line.find(':');
+        if (colon == string_view::npos) continue;
+        auto trim = [](string_view v) {
+            while (!v.empty() && isspace((unsigned char)v.front())) v.remove_prefix(1);
+            while (!v.empty() && isspace((unsigned char)v.back())) v.remove_suffix(1);
+            return v;
+        };
+        string_view key = trim(line.substr(0, colon)), value = trim(line.substr(colon + 1));
+        if (key == "DIMENSION") {
+            size_t dim = 0;
+            from_chars(value.data(), value.data() + value.size(), dim);
+            cities.reserve(dim);
+        } else if (key == "EDGE_WEIGHT_TYPE") {
+            if (value == "EUC_2D") metric = EUC_2D;
+            else if (value == "ATT") metric = ATT;
+            else if (value == "GEO") metric = GEO;
+            else {
+                cerr << "Unsupported EDGE_WEIGHT_TYPE: " << value << endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// GEO：座標是 DDD.MM (度.分)，換成弳度 (度數取整數部分，與 Concorde 相同)
+void geo_to_radians(vector<city> &cities) {
+    const double PI = 3.141592;  // TSPLIB 規定的值
+    auto convert = [&](double v) {
+        int deg = (int)v;
+        return PI * (deg + 5.0 * (v - deg) / 3.0) / 180.0;
+    };
+    for (city &c : cities) c = {convert(c.x), convert(c.y)};
+}
+
+// 讀取城市(x, y)座標，回傳距離的種類
+// 有 NODE_COORD_SECTION 就當作 TSPLIB，否則是原本的「編號 x y」格式 (距離為 EUCLID)
+// use_cache 時讀寫旁邊的 filename + ".bin"；檔案不存在或格式不支援時 cities 為空
+Metric read_city(const string &filename, vector<city> &cities, bool use_cache = true) {
+    cities.clear();
+    Metric metric = EUCLID;
+    MappedFile file(filename);
+    if (!file.data) return metric;
+
+    string cachename = filename + ".bin";
+    if (!use_cache || !load_coord_cache(cachename, file.info, cities, metric)) {
+        const char *p = file.data, *end = file.data + file.size;
+        string_view head(p, min(file.size, (size_t)1 << 16));  // 檔頭只在開頭找
+        size_t section = head.find("NODE_COORD_SECTION");
+        if (section != string_view::npos) {
+            if (!parse_tsplib_header(head.substr(0, section), cities, metric)) return metric;
+            p += section;
+            const char *eol = (const char *)memchr(p, '\n', end - p);
+            p = eol ? eol + 1 : end;
+        } else {
+            cities.reserve(file.size / 16);
+        }
+        parse_coords(p, end, cities);
+        if (use_cache) save_coord_cache(cachename, file.info, cities, metric);
+    }
+    if (metric == GEO) geo_to_radians(cities);
+    return metric;
+}
+
+// splitmix64：把一個種子展開成一串互不相關的種子
+uint64_t splitmix64(uint64_t &state) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// xoshiro256**：每條鏈 (每個執行緒) 一個，取代不能多執行緒共用的 rand()
+// 可直接給 shuffle 使用 (符合 UniformRandomBitGenerator)
+struct Rng {
+    using result_type = uint64_t;
+    uint64_t s[4];
+
+    explicit Rng(uint64_t seed) {
+        for (uint64_t &x : s) x = splitmix64(seed);
+    }
+
+    static constexpr uint64_t min() { return 0; }
+    static constexpr uint64_t max() { return UINT64_MAX; }
+
+    uint64_t operator()() {
+        auto rotl = [](uint64_t x, int k) { return (x << k) | (x >> (64 - k)); };
+        uint64_t result = rotl(s[1] * 5, 7) * 9, t = s[1] << 17;
+        s[2] ^= s[0], s[3] ^= s[1], s[1] ^= s[2], s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+        return result;
+    }
+
+    int below(int n) { return (int)(((*this)() >> 32) * (uint64_t)n >> 32); }  // [0, n)
+    double uniform() { return ((*this)() >> 11) * 0x1.0p-53; }              // [0, 1)
+};
+
+// 隨機生成最一開始的路徑 (同一個 seed 產生同一條路徑)
+vector<int> rand_generate_tour(int n, uint64_t seed) {
     vector<int> tour(n);
     for (int i = 0; i < n; ++i) tour[i] = i;
 
-    random_device rd;
-    default_random_engine g(rd());  // 隨機數生成器
+    Rng g(seed);  // 隨機數生成器
     shuffle(tour.begin(), tour.end(), g);
 
     return tour;
 }
 
-// 隨機改變路徑(交換兩城市位置)
-vector<int> change_tour(const vector<int> &tour) {
-    vector<int> neighbor = tour;
-    int a = rand() % tour.size();
-    int b = rand() % tour.size();
-    swap(neighbor[a], neighbor[b]);
-    return neighbor;
+// 均勻網格：把城市依座標分桶 (CSR)，每格平均約 per_cell 個城市
+struct CityGrid {
+    int G;
+    double min_x, min_y, cw, ch;
+    vector<int> cell_start, cell_city;  // 第 g 格的城市為 cell_city[cell_start[g] .. cell_start[g+1])
+
+    CityGrid(const vector<city> &cities, double per_cell) {
+        int n = cities.size();
+        min_x = cities[0].x, min_y = cities[0].y;
+        double max_x = min_x, max_y = min_y;
+        for (const city &c : cities) {
+            min_x = min(min_x, c.x), max_x = max(max_x, c.x);
+            min_y = min(min_y, c.y), max_y = max(max_y, c.y);
+        }
+        G = max(1, (int)sqrt(n / per_cell));
+        cw = max((max_x - min_x) / G, 1e-12), ch = max((max_y - min_y) / G, 1e-12);
+
+        cell_start.assign(G * G + 1, 0);
+        cell_city.resize(n);
+        for (const city &c : cities) cell_start[cell(c) + 1]++;
+        for (int i = 0; i < G * G; ++i) cell_start[i + 1] += cell_start[i];
+        vector<int> fill(cell_start.begin(), cell_start.end() - 1);
+        for (int i = 0; i < n; ++i) cell_city[fill[cell(cities[i])]++] = i;
+    }
+
+    int cell(const city &c, int &gx, int &gy) const {
+        gx = min(G - 1, (int)((c.x - min_x) / cw));
+        gy = min(G - 1, (int)((c.y - min_y) / ch));
+        return gy * G + gx;
+    }
+    int cell(const city &c) const {
+        int gx, gy;
+        return cell(c, gx, gy);
+    }
+
+    // 依序走過以 (gx, gy) 為中心、第 r 圈的每一格，呼叫 f(格子編號)
+    template <class F>
+    void ring(int gx, int gy, int r, F &&f) const {
+        for (int y = max(0, gy - r); y <= min(G - 1, gy + r); ++y) {
+            for (int x = max(0, gx - r); x <= min(G - 1, gx + r); ++x) {
+                if (max(abs(x - gx), abs(y - gy)) == r) f(y * G + x);  // 只看這一圈
+            }
+        }
+    }
+};
+
+// 每個城市最近的 k 個城市，nbr[c * k ..  c * k + k - 1] 由近到遠
+// 以均勻網格分桶，從城市所在的格子一圈一圈往外找，找到 k 個且下一圈不可能更近就停
+struct NeighborLists {
+    int k = 0;
+    vector<int> nbr;
+
+    NeighborLists(const vector<city> &cities, int want) {
+        int n = cities.size();
+        k = max(0, min(want, n - 1));
+        nbr.resize((size_t)n * k);
+        if (k == 0) return;
+
+        CityGrid grid(cities, 2);
+        vector<pair<double, int>> cand;
+        for (int i = 0; i < n; ++i) {
+            int gx, gy;
+            grid.cell(cities[i], gx, gy);
+            cand.clear();
+            for (int r = 0; r < grid.G; ++r) {
+                grid.ring(gx, gy, r, [&](int g) {
+                    for (int t = grid.cell_start[g]; t < grid.cell_start[g + 1]; ++t) {
+                        int j = grid.cell_city[t];
+                        if (j != i) cand.push_back({distance(cities[i], cities[j]), j});
+                    }
+                });
+                // 第 r + 1 圈的城市至少距離 r 格
+                if ((int)cand.size() >= k) {
+                    nth_element(cand.begin(), cand.begin() + k - 1, cand.end());
+                    if (cand[k - 1].first <= r * min(grid.cw, grid.ch)) break;
+                }
+            }
+            partial_sort(cand.begin(), cand.begin() + k, cand.end());
+            for (int t = 0; t < k; ++t) nbr[(size_t)i * k + t] = cand[t].second;
+        }
+    }
+
+    int random_of(int c, Rng &rng) const { return nbr[(size_t)c * k + rng.below(k)]; }
+};
+
+// ---- 初始路徑：城市很多時隨機路徑離好的解太遠，退火的前半段都花在把它理順 ----
+
+// 沿 Hilbert 曲線排序：把座標量化到 2^16 x 2^16 的格點，依曲線上的順序走過，O(n log n)
+vector<int> sfc_tour(const vector<city> &cities) {
+    int n = cities.size();
+    double min_x = cities[0].x, max_x = min_x, min_y = cities[0].y, max_y = min_y;
+    for (const city &c : cities) {
+        min_x = min(min_x, c.x), max_x = max(max_x, c.x);
+        min_y = min(min_y, c.y), max_y = max(max_y, c.y);
+    }
+    const uint32_t side = 1 << 16;
+    double scale = (side - 1) / max({max_x - min_x, max_y - min_y, 1e-12});
+    vector<pair<uint64_t, int>> key(n);
+    for (int i = 0; i < n; ++i) {
+        uint32_t x = (cities[i].x - min_x) * scale, y = (cities[i].y - min_y) * scale;
+        uint64_t d = 0;
+        for (uint32_t s = side / 2; s > 0; s /= 2) {  // 標準的 (x, y) -> Hilbert 距離
+            uint32_t rx = (x & s) > 0, ry = (y & s) > 0;
+            d += (uint64_t)s * s * ((3 * rx) ^ ry);
+            if (ry == 0) {
+                if (rx == 1) x = side - 1 - x, y = side - 1 - y;
+                swap(x, y);
+            }
+        }
+        key[i] = {d, i};
+    }
+    sort(key.begin(), key.end());
+    vector<int> tour(n);
+    for (int i = 0; i < n; ++i) tour[i] = key[i].second;
+    return tour;
 }
 
-vector<int> simul_anneal(const vector<city> &cities) {
+// 貪婪最近鄰：從 start 出發，每次走到最近的未拜訪城市
+// 未拜訪的城市放在網格裡 (拜訪後從格子移除)，從目前城市的格子一圈一圈往外找
+vector<int> greedy_tour(const vector<city> &cities, int start) {
     int n = cities.size();
-    int maxEvals = 1000 * n;    //限制條件，設定上限
+    CityGrid grid(cities, 2);
+    vector<int> left(grid.G * grid.G), where(n);  // 每格剩下幾個城市 (排在 cell_city 該格的前面)、城市在 cell_city 的位置
+    for (int g = 0; g < grid.G * grid.G; ++g) left[g] = grid.cell_start[g + 1] - grid.cell_start[g];
+    for (int t = 0; t < n; ++t) where[grid.cell_city[t]] = t;
+    auto remove = [&](int c) {
+        int g = grid.cell(cities[c]);
+        int last = grid.cell_start[g] + --left[g];
+        int other = grid.cell_city[last];
+        swap(grid.cell_city[where[c]], grid.cell_city[last]);
+        where[other] = where[c], where[c] = last;
+    };
 
-    vector<int> current = rand_generate_tour(n);
-    double current_cost = cal_length(cities, current);
+    vector<int> tour;
+    tour.reserve(n);
+    int cur = start;
+    remove(cur);
+    tour.push_back(cur);
+    while ((int)tour.size() < n) {
+        int gx, gy;
+        grid.cell(cities[cur], gx, gy);
+        int best = -1;
+        double best_d = 0;
+        for (int r = 0; r < grid.G; ++r) {
+            grid.ring(gx, gy, r, [&](int g) {
+                for (int t = grid.cell_start[g]; t < grid.cell_start[g] + left[g]; ++t) {
+                    int j = grid.cell_city[t];
+                    double d = distance(cities[cur], cities[j]);
+                    if (best < 0 || d < best_d) best = j, best_d = d;
+                }
+            });
+            if (best >= 0 && best_d <= r * min(grid.cw, grid.ch)) break;
+        }
+        cur = best;
+        remove(cur);
+        tour.push_back(cur);
+    }
+    return tour;
+}
 
-    vector<int> best = current;
-    double best_cost = current_cost;
+// 初始路徑：random (隨機排列)、sfc (Hilbert 曲線) 或 greedy (貪婪最近鄰，起點由 seed 決定)
+vector<int> initial_tour(const vector<city> &cities, const string &init, uint64_t seed) {
+    int n = cities.size();
+    if (init == "sfc") return sfc_tour(cities);
+    if (init == "greedy") return greedy_tour(cities, Rng(seed).below(n));
+    return rand_generate_tour(n, seed);
+}
+
+// ---- 距離引擎：dist(a, b) 回傳城市 a、b 的距離，移動的 delta() 都透過它取距離 ----
+
+// 直接由 SoA 座標計算
+// TSPLIB 的距離種類在這裡分支 (同一次執行中方向固定，分支預測幾乎不會錯)；matrix 與 cache 都由它建表
+struct ExactDistance {
+    const CitySoA &p;
+    double operator()(int a, int b) const {
+        if (p.metric != EUCLID) return metric_distance(p.metric, p.x[a], p.y[a], p.x[b], p.y[b]);
+        double dx = p.x[a] - p.x[b], dy = p.y[a] - p.y[b];
+        return sqrt(dx * dx + dy * dy);
+    }
+};
+
+// 事先算好的 n x n float 距離矩陣，適合 n 在幾千以內
+struct MatrixDistance {
+    int n;
+    vector<float> d;
+    explicit MatrixDistance(const CitySoA &p) : n(p.x.size()), d((size_t)n * n) {
+        ExactDistance exact{p};
+        for (int a = 0; a < n; ++a) {
+            for (int b = a; b < n; ++b) d[(size_t)a * n + b] = d[(size_t)b * n + a] = exact(a, b);
+        }
+    }
+    double operator()(int a, int b) const { return d[(size_t)a * n + b]; }
+};
 
-    double T = 10000;         // 初始溫度
-    double coolingRate = 0.999; // 降溫速率
+// n 太大放不下矩陣時：近鄰的距離事先存好 (2-opt / Or-opt 新接上的邊大多是近鄰)，
+// 其餘的查一個直接映射的快取 (每格只留最近一次用到的那一對)，沒有才計算
+struct CachedDistance {
+    struct Entry {
+        uint64_t key = ~0ULL;
+        float d = 0;
+    };
+    ExactDistance exact;
+    const NeighborLists &nl;
+    vector<float> near;            // near[c * k + t] = c 到第 t 個近鄰的距離
+    mutable vector<Entry> cache;
+    static const int CACHE_BITS = 20;
 
-    int evals = 0;          // 評估次數
-    while (evals < maxEvals && T > 1e-100) {
-        vector<int> neighbor = change_tour(current);
-        double lengh_cost = cal_length(cities, neighbor);
-        double delta = lengh_cost - current_cost;
+    CachedDistance(const CitySoA &p, const NeighborLists &lists)
+        : exact{p}, nl(lists), near(lists.nbr.size()), cache(1 << CACHE_BITS) {
+        for (size_t c = 0; nl.k > 0 && c < near.size() / nl.k; ++c) {
+            for (int t = 0; t < nl.k; ++t) near[c * nl.k + t] = exact(c, nl.nbr[c * nl.k + t]);
+        }
+    }
 
-        if (delta < 0 || (exp(-delta / T) > ((double) rand() / RAND_MAX))) {
-            current = neighbor;
-            current_cost = lengh_cost;
-            if (current_cost < best_cost) {
-                best = current;
-                best_cost = current_cost;
+    double operator()(int a, int b) const {
+        const int *nb = nl.nbr.data() + (size_t)a * nl.k;
+        for (int t = 0; t < nl.k; ++t) {
+            if (nb[t] == b) return near[(size_t)a * nl.k + t];
+        }
+        uint64_t key = (uint64_t)min(a, b) << 32 | (uint32_t)max(a, b);
+        Entry &e = cache[(key * 0x9E3779B97F4A7C15ULL) >> (64 - CACHE_BITS)];
+        if (e.key != key) e = {key, (float)exact(a, b)};
+        return e.d;
+    }
+};
+
+// 距離引擎：auto 依 n 與可用記憶體自動選擇，呼叫 f(引擎)，與 DFS.cpp 的 with_clause_store 相同的寫法
+// 實測 SoA 座標直接算 sqrt 已經很快，矩陣只有在小到能留在快取裡 (n <= 1024，4MB) 時才划算，
+// 更大的 n 查表反而比計算慢，所以 auto 在 n 較大時用 exact；cache 需要明確指定 (--dist=cache)
+template <class F>
+auto with_distance(const CitySoA &p, const NeighborLists &nl, const string &backend, F &&f) {
+    size_t n = p.x.size();
+    string use = backend;
+    if (use == "auto") {
+        double matrix_bytes = (double)n * n * sizeof(float);
+        double avail = (double)sysconf(_SC_AVPHYS_PAGES) * sysconf(_SC_PAGESIZE);
+        use = n <= 1024 && (avail <= 0 || matrix_bytes <= avail / 4) ? "matrix" : "exact";
+    }
+    if (use == "matrix") return f(MatrixDistance(p));
+    if (use == "cache") return f(CachedDistance(p, nl));
+    return f(ExactDistance{p});
+}
+
+// 以下的移動都直接在原路徑上修改，並維護 pos[城市] = 在路徑上的位置
+// delta() 只看被拿掉與新加上的邊，因此不用重算整條路徑
+
+// 交換路徑上位置 a 與 b 的兩個城市
+// 只有以 a-1, a, b-1, b 為起點的邊會改變
+struct SwapMove {
+    int a, b;
+
+    bool noop() const { return a == b; }
+
+    // 交換後位置 i 上的城市
+    int city_at(const vector<int> &tour, int i) const {
+        return i == a ? tour[b] : i == b ? tour[a] : tour[i];
+    }
+
+    // 路徑長度的變化量：a、b 相鄰 (包含頭尾相接) 時受影響的邊會重複，重複的只算一次
+    template <class Dist>
+    double delta(const Dist &dist, const vector<int> &tour) const {
+        if (a == b) return 0;
+        int n = tour.size();
+        int edges[4] = {(a + n - 1) % n, a, (b + n - 1) % n, b};
+        double d = 0;
+        for (int k = 0; k < 4; ++k) {
+            int i = edges[k], j = (i + 1) % n;
+            if (find(edges, edges + k, i) != edges + k) continue;
+            d += dist(city_at(tour, i), city_at(tour, j)) - dist(tour[i], tour[j]);
+        }
+        return d;
+    }
+
+    void apply(vector<int> &tour, vector<int> &pos) const {
+        swap(tour[a], tour[b]);
+        pos[tour[a]] = a;
+        pos[tour[b]] = b;
+    }
+};
+
+// 2-opt：拿掉邊 (i, i+1) 與 (j, j+1)，把 tour[i+1 .. j] 反轉，接上 (tour[i], tour[j]) 與 (tour[i+1], tour[j+1])
+struct TwoOptMove {
+    int i, j;  // i < j
+
+    // 兩條邊相鄰時 (j == i+1 或頭尾相接) 反轉後路徑不變
+    bool noop(int n) const { return j - i < 2 || (i == 0 && j == n - 1); }
+
+    template <class Dist>
+    double delta(const Dist &dist, const vector<int> &tour) const {
+        int n = tour.size();
+        if (noop(n)) return 0;
+        int a = tour[i], b = tour[i + 1], c = tour[j], d = tour[(j + 1) % n];
+        return dist(a, c) + dist(b, d) - dist(a, b) - dist(c, d);
+    }
+
+    // 反轉較短的一邊：反轉 tour[j+1 .. i] (繞過頭尾) 得到的是方向相反的同一條路徑
+    void apply(vector<int> &tour, vector<int> &pos) const {
+        int n = tour.size();
+        int l = i + 1, r = j, len = j - i;
+        if (len * 2 > n) l = j + 1, r = i + n, len = n - len;
+        for (int t = 0; t < len / 2; ++t) {
+            int x = (l + t) % n, y = (r - t) % n;
+            swap(tour[x], tour[y]);
+            pos[tour[x]] = x;
+            pos[tour[y]] = y;
+        }
+    }
+};
+
+// Or-opt：把 tour[i .. i+len-1] 這一段 (1~3 個城市) 搬到邊 (g, g+1) 之間，reversed 時倒過來接
+struct OrOptMove {
+    int i, len, g;
+    bool reversed;
+
+    // g 是這一段本身或與它相接的邊時不算移動
+    bool noop(int n) const { return (g - i + 1 + n) % n <= len; }
+
+    template <class Dist>
+    double delta(const Dist &dist, const vector<int> &tour) const {
+        int n = tour.size();
+        if (noop(n)) return 0;
+        int prev = tour[(i + n - 1) % n], next = tour[(i + len) % n];
+        int s0 = tour[i], s1 = tour[i + len - 1];
+        int u = tour[g], v = tour[(g + 1) % n];
+        int first = reversed ? s1 : s0, last = reversed ? s0 : s1;
+        return dist(prev, next) + dist(u, first) + dist(last, v)
+             - dist(prev, s0) - dist(s1, next) - dist(u, v);
+    }
+
+    // 段落不會跨過頭尾 (i + len <= n)，以 rotate 搬動中間的城市
+    void apply(vector<int> &tour, vector<int> &pos) const {
+        int lo, hi, at;  // 更新 pos 的範圍與這一段搬過去後的起點
+        if (g > i) {
+            rotate(tour.begin() + i, tour.begin() + i + len, tour.begin() + g + 1);
+            lo = i, hi = g + 1, at = g + 1 - len;
+        } else {
+            rotate(tour.begin() + g + 1, tour.begin() + i, tour.begin() + i + len);
+            lo = g + 1, hi = i + len, at = g + 1;
+        }
+        if (reversed) reverse(tour.begin() + at, tour.begin() + at + len);
+        for (int t = lo; t < hi; ++t) pos[tour[t]] = t;
+    }
+};
+
+// 鄰域：swap (原本的隨機交換兩城市)、2opt、oropt，或 mix (2-opt 與 Or-opt 各半)
+enum Neighborhood { SWAP, TWO_OPT, OR_OPT, MIX };
+
+Neighborhood parse_neighborhood(const string &name) {
+    if (name == "2opt") return TWO_OPT;
+    if (name == "oropt") return OR_OPT;
+    if (name == "mix") return MIX;
+    return SWAP;
+}
+
+// 隨機改變路徑(交換兩城市位置)
+SwapMove change_tour(int n, Rng &rng) {
+    int a = rng.below(n);
+    int b = rng.below(n);
+    return {a, b};
+}
+
+// 隨機選一個城市 a 與它的一個近鄰 c，讓 a、c 在路徑上相接
+TwoOptMove random_two_opt(const vector<int> &tour, const vector<int> &pos, const NeighborLists &nl, Rng &rng) {
+    int n = tour.size();
+    int a = rng.below(n), c = nl.random_of(a, rng);
+    int p = pos[a], q = pos[c];
+    if (rng() & 1) p = (p + n - 1) % n, q = (q + n - 1) % n;  // 改接 a、c 前面的兩條邊
+    return {min(p, q), max(p, q)};
+}
+
+// 隨機選一段 (1~3 個城市)，搬到第一個城市的某個近鄰 c 旁邊
+OrOptMove random_or_opt(const vector<int> &tour, const vector<int> &pos, const NeighborLists &nl, Rng &rng) {
+    int n = tour.size();
+    int len = 1 + rng.below(3);
+    int i = rng.below(n - len + 1);
+    int c = nl.random_of(tour[i], rng);
+    int g = pos[c];
+    if (rng() & 1) g = (g + n - 1) % n;  // 插在 c 的前面
+    return {i, len, g, (rng() & 1) != 0};
+}
+
+// 一條退火鏈：目前的路徑、位置索引與長度，自己的亂數產生器，以及延後複製的最佳路徑
+// 最佳路徑只在「目前就是最佳、又要接受變差的移動」時才複製，迴圈內不配置記憶體
+// 對齊 cache line：parallel tempering 的各條鏈放在同一個 vector，每步都會寫的欄位不能和相鄰的鏈共用 cache line
+struct alignas(64) Chain {
+    vector<int> tour, pos, best;
+    double cost, best_cost;
+    bool at_best = true;  // 目前的路徑就是最佳路徑 (best 還沒更新)
+    Rng rng;
+    long long uphill_tried = 0, uphill_accepted = 0;  // 變差的移動：評估次數與接受次數 (adaptive 排程用)
+    long long accepted = 0;                           // 被接受的移動總數 (進度輸出的接受率用)
+
+    Chain(vector<int> start, double length, uint64_t seed)
+        : tour(move(start)), pos(tour.size()), best(tour), cost(length), best_cost(length), rng(seed) {
+        for (int i = 0; i < (int)tour.size(); ++i) pos[tour[i]] = i;
+    }
+
+    // 評估一個移動，依 Metropolis 準則決定是否接受
+    template <class Dist, class Move>
+    void step(const Dist &dist, const Move &move, bool noop, double T) {
+        double delta = move.delta(dist, tour);
+        if (delta > 0) uphill_tried++;
+
+        if (delta < 0 || (exp(-delta / T) > rng.uniform())) {
+            if (delta > 0) uphill_accepted++;
+            accepted++;
+            if (!noop) {  // 路徑不變的移動不用套用
+                if (at_best && delta >= 0) best = tour;  // 沒有變得更好 --> 離開最佳解之前先存起來
+                move.apply(tour, pos);
+                cost += delta;
+                at_best = cost < best_cost;
+                if (at_best) best_cost = cost;
             }
         }
+    }
+
+    // 隨機產生一個 nb 鄰域的移動，呼叫 f(move, noop)
+    template <class F>
+    void random_move(Neighborhood nb, const NeighborLists &nl, F &&f) {
+        int n = tour.size();
+        if (nb == SWAP) {
+            SwapMove move = change_tour(n, rng);
+            f(move, move.noop());
+        } else if (nb == TWO_OPT || (nb == MIX && rng() & 1)) {
+            TwoOptMove move = random_two_opt(tour, pos, nl, rng);
+            f(move, move.noop(n));
+        } else {
+            OrOptMove move = random_or_opt(tour, pos, nl, rng);
+            f(move, move.noop(n));
+        }
+    }
+
+    // 在溫度 T 下隨機產生一個移動並評估 (一次評估)
+    template <class Dist>
+    void propose(const Dist &dist, Neighborhood nb, const NeighborLists &nl, double T) {
+        random_move(nb, nl, [&](const auto &move, bool noop) { step(dist, move, noop, T); });
+    }
+
+    // 把延後的最佳路徑存起來
+    void save_best() {
+        if (at_best) best = tour;
+        at_best = false;
+    }
 
-        // 每n次評估輸出一次當前狀態
-        if (evals % 1000 == 0) {
-            cout << "[eval=" << evals << "] T=" << T << ", current_cost=" << current_cost << endl;
+    // 與另一條鏈交換目前的狀態 (路徑、位置索引、長度)，各自的最佳路徑不動
+    void exchange(Chain &other) {
+        save_best();
+        other.save_best();
+        swap(tour, other.tour);
+        swap(pos, other.pos);
+        swap(cost, other.cost);
+        for (Chain *c : {this, &other}) {
+            c->at_best = c->cost < c->best_cost;
+            if (c->at_best) c->best_cost = c->cost;
         }
+    }
+};
+
+// ---- 非同步的進度輸出 (telemetry)：搜尋執行緒只把取樣放進無鎖的環狀佇列，由背景執行緒寫出 ----
 
-        T *= coolingRate;
-        evals++;
+// 一筆取樣；event 為 sample、reheat 或 round (parallel tempering 的一輪)
+struct Sample {
+    const char *event;
+    long long eval;
+    double T, cost, best_cost, accept;  // accept：上一筆取樣到這一筆之間被接受的移動比例
+};
+
+// 單一生產者、單一消費者的環狀佇列 (容量為 2 的冪次)；滿了就丟掉新的取樣，push 永遠不等待
+template <class T>
+struct SpscRing {
+    vector<T> buf;
+    size_t mask;
+    alignas(64) atomic<size_t> head{0};  // 下一個要寫的位置 (只有生產者寫)
+    alignas(64) atomic<size_t> tail{0};  // 下一個要讀的位置 (只有消費者寫)
+
+    explicit SpscRing(size_t capacity) {
+        size_t cap = 1;
+        while (cap < capacity) cap <<= 1;
+        buf.resize(cap);
+        mask = cap - 1;
+    }
+
+    bool push(const T &x) {
+        size_t h = head.load(memory_order_relaxed);
+        if (h - tail.load(memory_order_acquire) > mask) return false;
+        buf[h & mask] = x;
+        head.store(h + 1, memory_order_release);
+        return true;
+    }
+
+    bool pop(T &x) {
+        size_t t = tail.load(memory_order_relaxed);
+        if (t == head.load(memory_order_acquire)) return false;
+        x = buf[t & mask];
+        tail.store(t + 1, memory_order_release);
+        return true;
+    }
+};
+
+// 目的地：stdout、stderr (文字，與原本的輸出相同)，或 .csv / 其他副檔名 (JSONL) 的檔案
+// every：每幾次評估取樣一次，0 為不取樣；interval_ms：背景執行緒多久醒來寫出一次
+// 同一時間只能有一個執行緒 push (parallel tempering 只在 barrier 的完成函式裡 push)
+struct Telemetry {
+    long long every;
+    int interval_ms;
+    SpscRing<Sample> ring;
+    long long dropped = 0;           // 佇列滿了而丟掉的取樣數 (生產者端)
+    atomic<size_t> written{0};       // 背景執行緒已寫出的取樣數
+    bool stop = false, wake = false;  // 由 mu 保護；搜尋執行緒不碰這把鎖
+    mutex mu;
+    condition_variable cv;
+    ofstream file;
+    ostream *out;
+    string format;                   // text、csv 或 jsonl
+    thread writer;
+
+    Telemetry(const string &target, long long every, int interval_ms, size_t capacity = 1 << 14)
+        : every(every), interval_ms(max(1, interval_ms)), ring(capacity) {
+        if (target == "stdout" || target == "stderr") {
+            out = target == "stdout" ? &cout : &cerr;
+            format = "text";
+        } else {
+            file.open(target);
+            if (!file) cerr << "Error opening telemetry file: " << target << endl;
+            out = &file;
+            format = target.size() >= 4 && target.substr(target.size() - 4) == ".csv" ? "csv" : "jsonl";
+            file.precision(10);
+            if (format == "csv") file << "event,eval,T,current_cost,best_cost,accept_rate\n";
+        }
+        writer = thread([this] { run(); });
     }
 
+    ~Telemetry() {
+        {
+            lock_guard<mutex> lock(mu);
+            stop = true;
+        }
+        cv.notify_one();
+        writer.join();
+        if (dropped > 0) cerr << "Telemetry: dropped " << dropped << " samples" << endl;
+    }
+
+    bool due(long long eval) const { return every > 0 && eval % every == 0; }
+
+    // 搜尋執行緒呼叫：只寫進佇列，不做 I/O
+    void push(const Sample &s) {
+        if (!ring.push(s)) dropped++;
+    }
+
+    // 叫醒背景執行緒，等它把已經放進佇列的取樣都寫完 (搜尋結束後呼叫，讓輸出不和之後的訊息交錯)
+    void flush() {
+        size_t target = ring.head.load(memory_order_acquire);
+        while (written.load(memory_order_acquire) < target) {
+            {
+                lock_guard<mutex> lock(mu);
+                wake = true;
+            }
+            cv.notify_one();
+            this_thread::sleep_for(chrono::microseconds(100));
+        }
+    }
+
+    void write(const Sample &s) {
+        if (format == "text") {
+            *out << "[eval=" << s.eval << "] ";
+            if (string(s.event) == "reheat") *out << "reheat to T=" << s.T << "\n";
+            else *out << "T=" << s.T << ", current_cost=" << s.cost << ", best_cost=" << s.best_cost
+                      << ", accept=" << s.accept << "\n";
+        } else if (format == "csv") {
+            *out << s.event << ',' << s.eval << ',' << s.T << ',' << s.cost << ',' << s.best_cost << ',' << s.accept << '\n';
+        } else {
+            *out << "{\"event\":\"" << s.event << "\",\"eval\":" << s.eval << ",\"T\":" << s.T
+                 << ",\"current_cost\":" << s.cost << ",\"best_cost\":" << s.best_cost
+                 << ",\"accept_rate\":" << s.accept << "}\n";
+        }
+    }
+
+    void run() {
+        Sample s;
+        while (true) {
+            bool done;
+            {
+                unique_lock<mutex> lock(mu);
+                cv.wait_for(lock, chrono::milliseconds(interval_ms), [&] { return stop || wake; });
+                done = stop, wake = false;  // 先讀 stop 再清空佇列，停止前放進去的取樣都會寫出
+            }
+            size_t k = 0;
+            while (ring.pop(s)) write(s), k++;
+            if (k > 0) {
+                out->flush();
+                written.fetch_add(k, memory_order_release);
+            }
+            if (done) break;
+        }
+    }
+};
+
+// ---- 大型實例 (10 萬個城市以上)：二層雙向串列的路徑，反轉一段只要 O(√n) ----
+
+// 二層雙向串列 (two-level doubly-linked list)：路徑切成約 √n 段，每段是一個城市陣列加上「是否反轉」的旗標，
+// 段與段之間以雙向串列相連，rank 為段在路徑上的順序 (從 head 開始為 0, 1, 2, ...)
+// next / prev 為 O(1)；反轉一段路徑時先把頭尾切成段的邊界，再把中間的段整段翻轉，O(√n)
+// 切開會讓段變多，段數超過原本的兩倍時依目前的順序重新切段 (O(n)，攤還下來每次反轉仍是 O(√n))
+struct TwoLevelTour {
+    struct Segment {
+        vector<int> city;      // 段內的城市，reversed 時在路徑上的順序是倒過來的
+        bool reversed = false;
+        int prev = 0, next = 0, rank = 0;
+    };
+    int n, group = 1, head = 0;  // 城市數、每段的目標大小、rank 為 0 的段
+    size_t base = 1;             // 重新切段後的段數
+    vector<int> seg, idx;        // seg[c]：城市 c 所在的段；idx[c]：c 在該段 city 陣列中的索引
+    vector<Segment> segs;
+    vector<int> scratch, ranks;  // flip 用的暫存，避免迴圈內配置
+
+    explicit TwoLevelTour(const vector<int> &order) : n(order.size()), seg(n), idx(n) { build(order); }
+
+    void build(const vector<int> &order) {
+        group = max(8, (int)sqrt(n));
+        int m = (n + group - 1) / group;
+        segs.assign(m, {});
+        for (int s = 0; s < m; ++s) {
+            Segment &S = segs[s];
+            S.city.assign(order.begin() + (size_t)s * group, order.begin() + min(n, (s + 1) * group));
+            S.prev = (s + m - 1) % m, S.next = (s + 1) % m, S.rank = s;
+            for (int t = 0; t < (int)S.city.size(); ++t) seg[S.city[t]] = s, idx[S.city[t]] = t;
+        }
+        head = 0, base = m;
+    }
+
+    // 從 head 的第一個城市開始的路徑
+    vector<int> order() const {
+        vector<int> tour(n);
+        int c = first(head);
+        for (int i = 0; i < n; ++i) tour[i] = c, c = next(c);
+        return tour;
+    }
+
+    int first(int s) const { return segs[s].reversed ? segs[s].city.back() : segs[s].city.front(); }
+    int last(int s) const { return segs[s].reversed ? segs[s].city.front() : segs[s].city.back(); }
+
+    // 城市 c 在所屬的段內、沿路徑方向是第幾個
+    int offset(int c) const {
+        const Segment &S = segs[seg[c]];
+        return S.reversed ? (int)S.city.size() - 1 - idx[c] : idx[c];
+    }
+
+    int next(int c) const {
+        const Segment &S = segs[seg[c]];
+        int i = idx[c] + (S.reversed ? -1 : 1);
+        return i < 0 || i >= (int)S.city.size() ? first(S.next) : S.city[i];
+    }
+
+    int prev(int c) const {
+        const Segment &S = segs[seg[c]];
+        int i = idx[c] + (S.reversed ? 1 : -1);
+        return i < 0 || i >= (int)S.city.size() ? last(S.prev) : S.city[i];
+    }
+
+    // 把城市 c 所在的段切成兩段，讓 c 成為後一段的第一個城市
+    void split_before(int c) {
+        int s = seg[c], k = offset(c);
+        if (k == 0) return;
+        int t = segs.size();
+        segs.emplace_back();
+        Segment &S = segs[s], &T = segs[t];
+        int size = S.city.size();
+        if (!S.reversed) {  // 路徑上的第 k 個以後就是陣列的 [k, size)
+            T.city.assign(S.city.begin() + k, S.city.end());
+            S.city.resize(k);
+        } else {            // 反轉時是陣列的 [0, size - k)
+            T.city.assign(S.city.begin(), S.city.begin() + (size - k));
+            S.city.erase(S.city.begin(), S.city.begin() + (size - k));
+            for (int i = 0; i < k; ++i) idx[S.city[i]] = i;
+        }
+        T.reversed = S.reversed;
+        for (int i = 0; i < (int)T.city.size(); ++i) seg[T.city[i]] = t, idx[T.city[i]] = i;
+
+        T.prev = s, T.next = S.next;
+        segs[S.next].prev = t;
+        S.next = t;
+        for (int cur = t, r = S.rank + 1; cur != head; cur = segs[cur].next) segs[cur].rank = r++;
+    }
+
+    // 從 b 往後走到 c 的城市數 (含兩端)；只算 b、c 在同一段或相鄰兩段的情況，其他回傳 -1
+    int short_length(int b, int c) const {
+        int sb = seg[b], sc = seg[c];
+        if (sb == sc && offset(c) >= offset(b)) return offset(c) - offset(b) + 1;
+        if (segs[sb].next == sc) return (int)segs[sb].city.size() - offset(b) + offset(c) + 1;
+        return -1;
+    }
+
+    // 直接兩兩交換城市來反轉 b .. c 這 len 個城市，O(len)，不用切段
+    void reverse_cities(int b, int c, int len) {
+        int s1 = seg[b], i1 = idx[b], s2 = seg[c], i2 = idx[c];
+        for (int t = 0; t < len / 2; ++t) {
+            int x = segs[s1].city[i1], y = segs[s2].city[i2];
+            segs[s1].city[i1] = y, seg[y] = s1, idx[y] = i1;
+            segs[s2].city[i2] = x, seg[x] = s2, idx[x] = i2;
+            // 兩端各往中間走一格 (可能跨到相鄰的段)
+            i1 += segs[s1].reversed ? -1 : 1;
+            if (i1 < 0 || i1 >= (int)segs[s1].city.size()) s1 = segs[s1].next, i1 = segs[s1].reversed ? segs[s1].city.size() - 1 : 0;
+            i2 += segs[s2].reversed ? 1 : -1;
+            if (i2 < 0 || i2 >= (int)segs[s2].city.size()) s2 = segs[s2].prev, i2 = segs[s2].reversed ? 0 : segs[s2].city.size() - 1;
+        }
+    }
+
+    // 反轉路徑上從 b 往後走到 c 的這一段 (含兩端)
+    // 實際翻轉的可能是另一邊 (從 next(c) 到 prev(b))，得到的是方向相反的同一條路徑
+    // 兩邊中有一邊只跨一兩段 (2-opt 接近鄰時的常見情況) 就直接交換城市，否則切段後整段翻轉
+    void flip(int b, int c) {
+        int a = prev(b), d = next(c);
+        if (b == c || d == b) return;  // 一個城市或整條路徑：反轉後不變
+        int len = short_length(b, c), other = short_length(d, a);
+        if (len >= 0 && len <= 2 * group) {
+            reverse_cities(b, c, len);
+            return;
+        }
+        if (other >= 0 && other <= 2 * group) {
+            reverse_cities(d, a, other);
+            return;
+        }
+        split_before(b);
+        split_before(d);
+        int s1 = seg[b], s2 = seg[c], m = segs.size();
+        int count = (segs[s2].rank - segs[s1].rank + m) % m + 1;
+        if (2 * count > m) s1 = seg[d], s2 = seg[a], count = m - count;
+
+        // 段的順序倒過來、每段的方向翻轉；rank 沿用原本這幾段的值
+        int before = segs[s1].prev, after = segs[s2].next;
+        scratch.clear();
+        for (int s = s1, t = 0; t < count; ++t, s = segs[s].next) scratch.push_back(s);
+        ranks.clear();
+        for (int s : scratch) ranks.push_back(segs[s].rank);
+        for (int t = 0; t < count; ++t) {
+            Segment &S = segs[scratch[t]];
+            swap(S.prev, S.next);
+            S.reversed = !S.reversed;
+            S.rank = ranks[count - 1 - t];
+            if (S.rank == 0) head = scratch[t];
+        }
+        segs[s2].prev = before, segs[before].next = s2;
+        segs[s1].next = after, segs[after].prev = s1;
+
+        if (segs.size() > 2 * base) build(order());
+    }
+
+    // 拿掉邊 (a, b) 與 (c, d)，接上 (a, c) 與 (b, d)；b、d 是 a、c 同一個方向的下一個城市
+    void exchange(int a, int b, int c, int d) {
+        if (next(a) == b) flip(b, c);  // ... a b ... c d ...  -> 反轉 b .. c
+        else flip(a, d);               // ... b a ... d c ...  -> 反轉 a .. d
+    }
+};
+
+// 以城市 (不是位置) 描述的 2-opt：拿掉 (a, b) 與 (c, d)，接上 (a, c) 與 (b, d)，b = next(a)、d = next(c)
+struct LinkedTwoOptMove {
+    int a, b, c, d;
+
+    bool noop() const { return c == b || d == a; }
+
+    template <class Dist>
+    double delta(const Dist &dist, const TwoLevelTour &) const {
+        if (noop()) return 0;
+        return dist(a, c) + dist(b, d) - dist(a, b) - dist(c, d);
+    }
+
+    void apply(TwoLevelTour &tour) const { tour.exchange(a, b, c, d); }
+};
+
+// 以城市描述的 Or-opt：把 s0 .. s1 (p 之後、q 之前) 搬到邊 (u, v) 之間，reversed 時倒過來接
+// 以兩到三次 exchange 完成：(p,s0)(u,v) -> (p,u)(s0,v)，(p,u)(q,s1) -> (p,q)(u,s1)，不反轉時再把 s1 .. s0 轉回來
+struct LinkedOrOptMove {
+    int p, s0, s1, q, u, v;
+    bool reversed, inside;  // inside：u 或 v 在這一段裡，或 u == p (不算移動)
+
+    bool noop() const { return inside; }
+
+    template <class Dist>
+    double delta(const Dist &dist, const TwoLevelTour &) const {
+        if (noop()) return 0;
+        int first = reversed ? s1 : s0, last = reversed ? s0 : s1;
+        return dist(p, q) + dist(u, first) + dist(last, v)
+             - dist(p, s0) - dist(s1, q) - dist(u, v);
+    }
+
+    void apply(TwoLevelTour &tour) const {
+        tour.exchange(p, s0, u, v);
+        tour.exchange(p, u, q, s1);
+        if (!reversed) tour.exchange(u, s1, s0, v);
+    }
+};
+
+// 一條退火鏈 (大型實例版)：路徑用 TwoLevelTour，移動都以城市描述
+// 最佳路徑每 n 次評估才檢查並複製一次 (O(n) 攤還到每次評估是 O(1))，回傳的是這些檢查點中最好的；
+// best_cost 仍是過程中真正的最小值 (停滯判斷用)
+struct LinkedChain {
+    TwoLevelTour tour;
+    vector<int> best;
+    double cost, best_cost, saved_cost;
+    Rng rng;
+    long long uphill_tried = 0, uphill_accepted = 0, accepted = 0;
+    int since_save = 0;
+
+    LinkedChain(const vector<int> &start, double length, uint64_t seed)
+        : tour(start), best(start), cost(length), best_cost(length), saved_cost(length), rng(seed) {}
+
+    template <class Dist, class Move>
+    void step(const Dist &dist, const Move &move, bool noop, double T) {
+        double delta = move.delta(dist, tour);
+        if (delta > 0) uphill_tried++;
+
+        if (delta < 0 || (exp(-delta / T) > rng.uniform())) {
+            if (delta > 0) uphill_accepted++;
+            accepted++;
+            if (!noop) {
+                move.apply(tour);
+                cost += delta;
+                best_cost = min(best_cost, cost);
+            }
+        }
+        if (++since_save >= tour.n) save_best();
+    }
+
+    // 隨機產生一個移動，呼叫 f(move, noop)；大型實例不用 swap，swap 當作 mix
+    template <class F>
+    void random_move(Neighborhood nb, const NeighborLists &nl, F &&f) {
+        int n = tour.n;
+        if (nb == TWO_OPT || (nb != OR_OPT && rng() & 1)) {
+            int a = rng.below(n), c = nl.random_of(a, rng);
+            if (rng() & 1) a = tour.prev(a), c = tour.prev(c);  // 改接 a、c 前面的兩條邊
+            LinkedTwoOptMove move{a, tour.next(a), c, tour.next(c)};
+            f(move, move.noop());
+        } else {
+            int len = 1 + rng.below(3);
+            int s0 = rng.below(n), s1 = s0;
+            for (int t = 1; t < len; ++t) s1 = tour.next(s1);
+            int u = nl.random_of(s0, rng), v = tour.next(u);
+            if (rng() & 1) v = u, u = tour.prev(u);  // 插在近鄰的前面
+            int p = tour.prev(s0), q = tour.next(s1);
+            bool inside = u == p;
+            for (int c = s0, t = 0; t < len; ++t, c = tour.next(c)) inside |= c == u || c == v;
+            LinkedOrOptMove move{p, s0, s1, q, u, v, (rng() & 1) != 0, inside};
+            f(move, move.noop());
+        }
+    }
+
+    template <class Dist>
+    void propose(const Dist &dist, Neighborhood nb, const NeighborLists &nl, double T) {
+        random_move(nb, nl, [&](const auto &move, bool noop) { step(dist, move, noop, T); });
+    }
+
+    // 目前的路徑比上一個檢查點好就存起來
+    void save_best() {
+        since_save = 0;
+        if (cost < saved_cost) {
+            best = tour.order();
+            saved_cost = cost;
+        }
+    }
+};
+
+// 退火的選項
+struct AnnealOptions {
+    Neighborhood nb = MIX;       // 鄰域
+    int knn = 8;                 // 2-opt / Or-opt 的端點從每個城市最近的 knn 個城市中挑
+    string dist = "auto";        // 距離引擎：auto、matrix、cache、exact
+    string schedule = "adaptive";   // 降溫排程：adaptive、geometric、lundy (Lundy-Mees)，或 legacy (原本的 T = 10000, 0.999)
+    double accept = -1;          // 初始溫度：讓變差的移動大約有這個比例會被接受；-1 為隨機初始路徑 0.5，sfc / greedy 0.1 (太熱會把好的起點打散)
+    double t_end_ratio = 1e-3;   // 最後的溫度 = 初始溫度 * t_end_ratio
+    int stall = -1;              // 連續幾次評估最佳解都沒進步就回溫 (或停止)；-1 為 100 * n，0 為不檢查，legacy 不檢查
+    int reheats = 3;             // 最多回溫幾次，用完後再停滯就停止
+    string tour = "auto";        // 路徑的表示法：array (陣列 + 位置索引)、linked (二層雙向串列)，auto 在 n > 10000 時用 linked
+    Metric metric = EUCLID;      // 距離的種類 (由 read_city 決定)
+    string init = "auto";        // 初始路徑：random、sfc、greedy，auto 在 linked 時用 greedy，否則 random
+    bool verbose = true;         // false 時不輸出結尾的摘要 (基準測試用)
+    Telemetry *telemetry = nullptr;  // 過程的取樣輸出，nullptr 為不輸出
+};
+
+// 降溫排程：每次評估後呼叫 update()，T 為目前溫度
+// geometric：T *= alpha；lundy：T = T / (1 + beta * T)，兩者都在剩下的評估次數內由 T0 降到 T_end
+// adaptive：每 window 次評估看變差的移動被接受的比例，比目標 (由 accept 等比降到 accept * t_end_ratio) 高就降溫，低就升溫
+struct Schedule {
+    string kind;
+    double T0, T_end, T;
+    double alpha = 1, beta = 0;
+    double accept0, accept_end;
+    int window;
+    long long budget, start = 0;  // 這一段排程的總評估次數與起點 (回溫後重新計算)
+    long long last_tried = 0, last_accepted = 0;
+
+    Schedule(const string &k, double t0, double ratio, double accept, long long evals, int n)
+        : kind(k), T0(t0), T_end(t0 * ratio), T(t0), accept0(accept), accept_end(accept * ratio),
+          window(max(100, n)), budget(evals) {
+        if (kind == "legacy") T = T0 = 10000, alpha = 0.999;
+        else restart(T0, 0, evals);
+    }
+
+    // 從溫度 from 重新開始，在 [at, budget) 之間降到 T_end
+    void restart(double from, long long at, long long total) {
+        T = from, start = at, budget = total;
+        double steps = max(1.0, (double)(total - at));
+        alpha = pow(T_end / T, 1 / steps);
+        beta = (T - T_end) / (steps * T * T_end);
+    }
+
+    template <class C>
+    void update(long long evals, const C &chain) {
+        if (kind == "geometric" || kind == "legacy") T *= alpha;
+        else if (kind == "lundy") T = T / (1 + beta * T);
+        else if (kind == "adaptive" && (evals - start) % window == 0) {
+            long long tried = chain.uphill_tried - last_tried, accepted = chain.uphill_accepted - last_accepted;
+            last_tried = chain.uphill_tried, last_accepted = chain.uphill_accepted;
+            double progress = (double)(evals - start) / max(1LL, budget - start);
+            double target = accept0 * pow(accept_end / accept0, min(1.0, progress));
+            double ratio = tried > 0 ? (double)accepted / tried : 0;
+            T *= ratio > target ? 0.9 : 1.1;
+        }
+    }
+
+    bool frozen() const { return kind == "legacy" && T <= 1e-100; }
+};
+
+// 初始溫度：從起點隨機評估一些移動 (不套用)，取變差的平均量 d，T0 = -d / ln(accept)
+template <class C, class Dist>
+double calibrate_T0(C &chain, const Dist &dist, Neighborhood nb, const NeighborLists &nl, double accept) {
+    double sum = 0;
+    int uphill = 0;
+    for (int k = 0; k < 1000; ++k) {
+        chain.random_move(nb, nl, [&](const auto &move, bool) {
+            double delta = move.delta(dist, chain.tour);
+            if (delta > 0) sum += delta, uphill++;
+        });
+    }
+    if (uphill == 0) return 1;
+    return -(sum / uphill) / log(min(max(accept, 1e-6), 0.999));
+}
+
+// 退火的主迴圈 (Chain 或 LinkedChain)：校正初始溫度後依排程降溫，停滯時回溫，回傳評估次數
+template <class C>
+long long anneal_chain(C &chain, const CitySoA &soa, const NeighborLists &nl, Neighborhood nb, const AnnealOptions &opt) {
+    int n = soa.x.size();
+    long long maxEvals = 1000LL * n;    //限制條件，設定上限 (1000 n 可超出 int 的範圍)
+    long long stall = opt.stall < 0 ? 100LL * n : opt.stall;
+
+    long long evals = 0;    // 評估次數
+    with_distance(soa, nl, opt.dist, [&](const auto &dist) {
+        double T0 = opt.schedule == "legacy" ? 10000 : calibrate_T0(chain, dist, nb, nl, opt.accept);
+        Schedule sched(opt.schedule, T0, opt.t_end_ratio, opt.accept, maxEvals, n);
+        double last_best = chain.best_cost;
+        long long last_improve = 0;
+        int reheats = 0;
+        Telemetry *tel = opt.telemetry;
+        long long last_eval = 0, last_accepted = 0;  // 上一筆取樣時的評估次數與接受次數
+        auto sample = [&](const char *event) {
+            double rate = evals > last_eval ? (double)(chain.accepted - last_accepted) / (evals - last_eval) : 0;
+            last_eval = evals, last_accepted = chain.accepted;
+            tel->push({event, evals, sched.T, chain.cost, chain.best_cost, rate});
+        };
+
+        while (evals < maxEvals && !sched.frozen()) {
+            chain.propose(dist, nb, nl, sched.T);
+            evals++;
+
+            // 停滯：回溫到目前溫度與 T0 的 10% 兩者中較高的，在剩下的評估次數內重新降溫；回溫次數用完就停止
+            if (chain.best_cost < last_best) {
+                last_best = chain.best_cost;
+                last_improve = evals;
+            } else if (stall > 0 && opt.schedule != "legacy" && evals - last_improve >= stall) {
+                if (reheats == opt.reheats) break;
+                reheats++;
+                last_improve = evals;
+                sched.restart(max(sched.T, 0.1 * T0), evals, maxEvals);
+                if (tel) sample("reheat");
+            }
+
+            // 每 every 次評估取樣一次當前狀態 (只放進佇列，由背景執行緒輸出)
+            if (tel && tel->due(evals)) sample("sample");
+
+            sched.update(evals, chain);
+        }
+    });
+
+    return evals;
+}
+
+// seed 決定初始路徑與之後所有的亂數，同一個 seed 結果相同
+// evals_out 不為空時寫回實際評估次數
+vector<int> simul_anneal(const vector<city> &cities, uint64_t seed, const AnnealOptions &opt = {}, long long *evals_out = nullptr) {
+    int n = cities.size();
+    Neighborhood nb = n < 8 ? SWAP : opt.nb;  // 城市太少時 2-opt / Or-opt 的端點會重疊
+    bool linked = n >= 8 && (opt.tour == "linked" || (opt.tour == "auto" && n > 10000));
+    if (linked && nb == SWAP) nb = MIX;
+    string init = opt.init != "auto" ? opt.init : linked ? "greedy" : "random";
+    AnnealOptions o = opt;
+    if (o.accept < 0) o.accept = init == "random" ? 0.5 : 0.1;
+
+    CitySoA soa(cities, opt.metric);
+    vector<int> start = initial_tour(cities, init, seed);
+    double length = cal_length_fast(soa, start);
+    NeighborLists nl(cities, nb == SWAP ? 0 : opt.knn);
+
+    long long evals;
+    vector<int> best;
+    if (linked) {
+        LinkedChain chain(start, length, seed);
+        evals = anneal_chain(chain, soa, nl, nb, o);
+        chain.save_best();
+        best = move(chain.best);
+    } else {
+        Chain chain(move(start), length, seed);
+        evals = anneal_chain(chain, soa, nl, nb, o);
+        chain.save_best();
+        best = move(chain.best);
+    }
+    if (evals_out) *evals_out = evals;
+    return best;
+}
+
+// Parallel tempering：R 條鏈各在一個執行緒上，以固定的溫度階梯 (等比) 同時退火
+// 每一輪每條鏈評估 n 次，全部到齊後由一個執行緒讓相鄰溫度的鏈以 min(1, exp((1/T_i - 1/T_j)(E_i - E_j))) 交換狀態，
+// 同時合併各鏈的最佳路徑 (只在到齊時做，執行中不需要上鎖)
+// 每條鏈的亂數種子與交換用的亂數都由 seed 以 splitmix64 展開，與執行緒的排程無關，同一個 seed 結果相同
+// 退火的選項只用到 nb、knn、dist、verbose 與 telemetry (溫度固定，不用降溫排程)
+vector<int> parallel_tempering(const vector<city> &cities, uint64_t seed, int R, const AnnealOptions &opt = {},
+                               long long *evals_out = nullptr) {
+    int n = cities.size();
+    Neighborhood nb = n < 8 ? SWAP : opt.nb;
+    R = max(1, R);
+    int sweep = max(100, n);                  // 每一輪每條鏈的評估次數
+    int rounds = (1000LL * n + sweep - 1) / sweep;  // 每條鏈的評估次數與 simul_anneal 的上限相同；sweep ≥ n，所以 rounds ≤ 1000
+
+    CitySoA soa(cities, opt.metric);
+    NeighborLists nl(cities, max(opt.knn, 1));
+    uint64_t state = seed;
+    Rng exchange_rng(splitmix64(state));
+
+    // 溫度的尺度：城市到最近鄰居的平均距離，2-opt / Or-opt 在好的路徑上的變化量大約是這個大小
+    double d1 = 0;
+    ExactDistance exact{soa};
+    for (int c = 0; c < n && nl.k > 0; ++c) d1 += exact(c, nl.nbr[(size_t)c * nl.k]) / n;
+    double T_max = max(d1, 1e-9), T_min = T_max * 0.01;
+    vector<double> temp(R);
+    for (int r = 0; r < R; ++r) temp[r] = R == 1 ? T_min : T_min * pow(T_max / T_min, (double)r / (R - 1));
+
+    vector<Chain> chains;
+    for (int r = 0; r < R; ++r) {
+        uint64_t chain_seed = splitmix64(state);
+        vector<int> start = rand_generate_tour(n, chain_seed);
+        double length = cal_length_fast(soa, start);
+        chains.emplace_back(move(start), length, chain_seed);
+    }
+
+    vector<int> best = chains[0].tour;
+    double best_cost = chains[0].cost;
+    long long swaps_tried = 0, swaps_done = 0;
+
+    with_distance(soa, nl, opt.dist, [&](const auto &dist) {
+        int round = 0;
+        // 全部的鏈到齊時執行 (只有一個執行緒)：合併最佳路徑，然後讓相鄰溫度的鏈嘗試交換 (奇偶輪交錯)
+        auto on_round = [&]() noexcept {
+            for (Chain &c : chains) {
+                if (c.best_cost < best_cost) {
+                    c.save_best();
+                    best = c.best;
+                    best_cost = c.best_cost;
+                }
+            }
+            for (int r = round & 1; r + 1 < R; r += 2) {
+                double x = (1 / temp[r] - 1 / temp[r + 1]) * (chains[r].cost - chains[r + 1].cost);
+                swaps_tried++;
+                if (x >= 0 || exp(x) > exchange_rng.uniform()) {
+                    chains[r].exchange(chains[r + 1]);
+                    swaps_done++;
+                }
+            }
+            // 每條鏈的評估次數跨過 every 的倍數時取樣：溫度與目前長度取最冷的鏈，接受率為交換成功的比例
+            round++;
+            Telemetry *tel = opt.telemetry;
+            long long evals = (long long)round * sweep;
+            if (tel && tel->every > 0 && evals / tel->every != (evals - sweep) / tel->every) {
+                tel->push({"round", evals, temp[0], chains[0].cost, best_cost,
+                           swaps_tried > 0 ? (double)swaps_done / swaps_tried : 0});
+            }
+        };
+        barrier sync(R, on_round);
+
+        // CachedDistance 的快取會被寫入，每個執行緒各用一份；其他引擎唯讀，共用同一份
+        auto worker = [&](int r) {
+            using Dist = decay_t<decltype(dist)>;
+            optional<Dist> own;
+            if constexpr (is_same_v<Dist, CachedDistance>) own.emplace(dist);
+            const Dist &d = own ? *own : dist;
+            for (int k = 0; k < rounds; ++k) {
+                for (int e = 0; e < sweep; ++e) chains[r].propose(d, nb, nl, temp[r]);
+                sync.arrive_and_wait();
+            }
+        };
+        vector<thread> threads;
+        for (int r = 0; r < R; ++r) threads.emplace_back(worker, r);
+        for (auto &t : threads) t.join();
+    });
+
+    if (opt.telemetry) opt.telemetry->flush();
+    if (opt.verbose) cout << "Replica exchanges: " << swaps_done << " / " << swaps_tried << endl;
+    if (evals_out) *evals_out = (long long)rounds * sweep * R;  // 約 1000 n R，超出 int 的範圍，全程用 long long
     return best;
 }
 
+// ---- 退火後的局部最佳化 (polish)：只看近鄰的 2-opt 與 Or-opt，以 don't-look bits 做到局部最佳 ----
+// level 為 lk 時再加上 Or-3opt (LK 式的三層循序搜尋：a→b、pred(b)→e、pred(e)→succ(a)，三段中間兩段對調，不反轉)
+struct PolishResult {
+    double before = 0, after = 0, seconds = 0;
+    long long moves = 0;
+};
+
+template <class Dist>
+struct Polisher {
+    const Dist &dist;
+    const NeighborLists &nl;
+    vector<int> &tour;
+    vector<int> pos;
+    vector<char> active;   // don't-look bit 的反面：1 表示還要檢查這個城市
+    deque<int> queue;
+    bool lk;
+    long long moves = 0;
+    static constexpr double EPS = 1e-7;
+
+    Polisher(const Dist &d, const NeighborLists &lists, vector<int> &t, bool use_lk)
+        : dist(d), nl(lists), tour(t), pos(t.size()), active(t.size(), 1), lk(use_lk) {
+        for (int i = 0; i < (int)tour.size(); ++i) pos[tour[i]] = i, queue.push_back(tour[i]);
+    }
+
+    int n() const { return tour.size(); }
+    int succ(int c) const { return tour[(pos[c] + 1) % n()]; }
+    int pred(int c) const { return tour[(pos[c] + n() - 1) % n()]; }
+
+    // 路徑改變後，端點附近的城市要重新檢查
+    void wake(initializer_list<int> cities) {
+        for (int c : cities) {
+            if (!active[c]) active[c] = 1, queue.push_back(c);
+        }
+    }
+
+    // 2-opt：a 與近鄰 c 相接，另一條新邊接在兩者的後繼 (或前驅) 之間
+    bool try_two_opt(int a) {
+        for (int dir = 0; dir < 2; ++dir) {
+            int a2 = dir == 0 ? succ(a) : pred(a);
+            double d1 = dist(a, a2);
+            for (int t = 0; t < nl.k; ++t) {
+                int c = nl.nbr[(size_t)a * nl.k + t];
+                double g = d1 - dist(a, c);
+                if (g <= EPS) break;  // 近鄰由近到遠，之後的只會更差
+                int c2 = dir == 0 ? succ(c) : pred(c);
+                if (c2 == a || c == a2) continue;
+                double delta = dist(a2, c2) - dist(c, c2) - g;
+                if (delta < -EPS) {
+                    int p = pos[a], q = pos[c];
+                    if (dir == 1) p = (p + n() - 1) % n(), q = (q + n() - 1) % n();
+                    TwoOptMove{min(p, q), max(p, q)}.apply(tour, pos);
+                    wake({a, a2, c, c2});
+                    moves++;
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    // Or-opt：以 a 開頭的 1~3 個城市，搬到某個近鄰 c 的旁邊 (正向或反向)
+    bool try_or_opt(int a) {
+        for (int len = 1; len <= 3 && len + 2 < n(); ++len) {
+            int i = pos[a];
+            if (i + len > n()) break;  // 段落不跨過頭尾
+            for (int end = 0; end < 2; ++end) {  // 新邊接在段落的頭或尾
+                int s = tour[end == 0 ? i : i + len - 1];
+                for (int t = 0; t < nl.k; ++t) {
+                    int c = nl.nbr[(size_t)s * nl.k + t];
+                    int pc = pos[c];
+                    if (pc >= i && pc < i + len) continue;
+                    for (int side = 0; side < 2; ++side) {  // 插在 c 之後或之前
+                        int g = side == 0 ? pc : (pc + n() - 1) % n();
+                        // s 要與 c 相接：插在 c 之後時段落的第一個城市是 s，之前時最後一個是 s
+                        bool reversed = (side == 0) != (end == 0);
+                        OrOptMove move{i, len, g, reversed};
+                        if (move.noop(n())) continue;
+                        double delta = move.delta(dist, tour);
+                        if (delta < -EPS) {
+                            int prev = pred(tour[i]), next = tour[(i + len) % n()], u = tour[g], v = tour[(g + 1) % n()];
+                            move.apply(tour, pos);
+                            wake({a, s, c, prev, next, u, v, tour[i]});
+                            moves++;
+                            return true;
+                        }
+                    }
+                }
+            }
+        }
+        return false;
+    }
+
+    // Or-3opt：邊 (a, a') 換成 (a, b)，b 的前驅 c 改接近鄰 e，e 的前驅 f 接回 a'
+    // 切點 i < j < k (依路徑順序) 把路徑分成三段，中間兩段對調，整個移動與從哪個切點開始看無關
+    bool try_or3(int a) {
+        int i = pos[a], a2 = succ(a);
+        double d1 = dist(a, a2);
+        for (int t = 0; t < nl.k; ++t) {
+            int b = nl.nbr[(size_t)a * nl.k + t];
+            double g1 = d1 - dist(a, b);
+            if (g1 <= EPS) break;
+            int c = pred(b);
+            int oj = (pos[c] - i + n()) % n();  // 第二個切點離 i 的距離
+            if (oj == 0 || b == a2) continue;
+            for (int u = 0; u < nl.k; ++u) {
+                int e = nl.nbr[(size_t)c * nl.k + u];
+                double g2 = g1 + dist(c, b) - dist(c, e);
+                if (g2 <= EPS) break;
+                int f = pred(e);
+                int ok = (pos[f] - i + n()) % n();
+                if (ok <= oj || e == b) continue;  // 第三個切點要在 b 之後
+                double gain = g2 + dist(f, e) - dist(f, a2);
+                if (gain > EPS) {
+                    int cut[3] = {i, pos[c], pos[f]};
+                    sort(cut, cut + 3);
+                    rotate(tour.begin() + cut[0] + 1, tour.begin() + cut[1] + 1, tour.begin() + cut[2] + 1);
+                    for (int p = cut[0] + 1; p <= cut[2]; ++p) pos[tour[p]] = p;
+                    wake({a, a2, b, c, e, f});
+                    moves++;
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    void run() {
+        if (n() < 8 || nl.k == 0) return;
+        while (!queue.empty()) {
+            int a = queue.front();
+            queue.pop_front();
+            active[a] = 0;
+            if (try_two_opt(a) || try_or_opt(a) || (lk && try_or3(a))) wake({a});
+        }
+    }
+};
+
+// level：local (2-opt + Or-opt) 或 lk (再加上 Or-3opt)；回傳前後的長度 (以 cal_length 計算) 與花費的時間
+PolishResult polish(const vector<city> &cities, vector<int> &tour, const string &level, int knn, const string &dist_backend,
+                    Metric metric = EUCLID) {
+    PolishResult r;
+    auto start = chrono::steady_clock::now();
+    r.before = cal_length(cities, tour, metric);
+    CitySoA soa(cities, metric);
+    NeighborLists nl(cities, knn);
+    with_distance(soa, nl, dist_backend, [&](const auto &dist) {
+        Polisher<decay_t<decltype(dist)>> p(dist, nl, tour, level == "lk");
+        p.run();
+        r.moves = p.moves;
+    });
+    r.after = cal_length(cities, tour, metric);
+    r.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return r;
+}
+
 void saveResult(const string &filename, const vector<int> &tour) {
     ofstream file(filename);
     for (int i : tour) file << i << " ";
@@ -110,24 +1658,274 @@ void saveResult(const string &filename, const vector<int> &tour) {
     file.close();
 }
 
-int main() {
-    srand(time(0));
+// 基準測試：先跑 warmup 次不計時，再計時 reps 次，回報中位數、p95 與吞吐量 (work / 中位數)
+struct BenchResult {
+    string name;
+    string unit;        // 吞吐量單位，例如 nodes/s
+    double work;        // 每次執行的工作量
+    vector<double> secs;
+    double median = 0, p95 = 0;
+    double tour_length = -1;  // simul_anneal 最後的路徑長度，< 0 表示不適用
+};
+
+template <class F>
+BenchResult run_bench(const string &name, const string &unit, double work, int warmup, int reps, F &&f) {
+    BenchResult r{name, unit, work, {}};
+    for (int i = 0; i < warmup; ++i) f();
+    for (int i = 0; i < reps; ++i) {
+        auto t0 = chrono::steady_clock::now();
+        f();
+        r.secs.push_back(chrono::duration<double>(chrono::steady_clock::now() - t0).count());
+    }
+    vector<double> sorted = r.secs;
+    sort(sorted.begin(), sorted.end());
+    r.median = sorted[sorted.size() / 2];
+    r.p95 = sorted[min(sorted.size() - 1, (size_t)ceil(0.95 * sorted.size()) - 1)];
+    cout << name << ": median " << r.median << " s, p95 " << r.p95 << " s, "
+         << (r.median > 0 ? work / r.median : 0) << " " << unit << endl;
+    return r;
+}
+
+// 依副檔名輸出 JSON 或 CSV
+void save_bench(const string &filename, const string &program, const vector<BenchResult> &results) {
+    ofstream out(filename);
+    bool json = filename.size() >= 5 && filename.compare(filename.size() - 5, 5, ".json") == 0;
+    if (json) {
+        out << "{\"program\": \"" << program << "\", \"results\": [\n";
+        for (size_t i = 0; i < results.size(); ++i) {
+            const BenchResult &r = results[i];
+            out << "  {\"name\": \"" << r.name << "\", \"reps\": " << r.secs.size() << ", \"median_s\": " << r.median
+                << ", \"p95_s\": " << r.p95 << ", \"throughput\": " << (r.median > 0 ? r.work / r.median : 0)
+                << ", \"unit\": \"" << r.unit << "\"";
+            if (r.tour_length >= 0) out << ", \"tour_length\": " << r.tour_length;
+            out << ", \"samples_s\": [";
+            for (size_t k = 0; k < r.secs.size(); ++k) out << (k ? ", " : "") << r.secs[k];
+            out << "]}" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        out << "]}\n";
+    } else {
+        out << "program,name,reps,median_s,p95_s,throughput,unit\n";
+        for (const BenchResult &r : results) {
+            out << program << "," << r.name << "," << r.secs.size() << "," << r.median << "," << r.p95 << ","
+                << (r.median > 0 ? r.work / r.median : 0) << "," << r.unit << "\n";
+        }
+    }
+}
+
+// 解析逗號分隔的整數清單，例如 --bench-sizes=50,100,200
+vector<int> parse_list(const string &s) {
+    vector<int> v;
+    stringstream ss(s);
+    string token;
+    while (getline(ss, token, ',')) v.push_back(stoi(token));
+    return v;
+}
+
+// 在 [0, 1000) x [0, 1000) 隨機產生 n 個城市
+vector<city> generate_cities(int n, unsigned seed) {
+    default_random_engine g(seed);
+    uniform_real_distribution<double> coord(0.0, 1000.0);
+    vector<city> cities(n);
+    for (city &c : cities) c = {coord(g), coord(g)};
+    return cities;
+}
+
+// 對每個 n 量測 cal_length、read_city 與整個 simul_anneal
+vector<BenchResult> run_benchmarks(const vector<int> &sizes, int warmup, int reps) {
+    vector<BenchResult> results;
+    volatile double sink = 0;  // 寫入 volatile，避免結果沒被用到而被編譯器省略
+
+    for (int n : sizes) {
+        string tag = "/n=" + to_string(n);
+        vector<city> cities = generate_cities(n, n);
+        vector<int> tour = rand_generate_tour(n, n);
+
+        const int calls = 1000;
+        results.push_back(run_bench("cal_length" + tag, "evals/s", calls, warmup, reps, [&] {
+            for (int i = 0; i < calls; ++i) sink = sink + cal_length(cities, tour);
+        }));
+        CitySoA soa(cities);
+        results.push_back(run_bench("cal_length_soa_scalar" + tag, "evals/s", calls, warmup, reps, [&] {
+            for (int i = 0; i < calls; ++i) sink = sink + cal_length_soa_scalar(soa, tour);
+        }));
+        results.push_back(run_bench("cal_length_fast" + tag, "evals/s", calls, warmup, reps, [&] {
+            for (int i = 0; i < calls; ++i) sink = sink + cal_length_fast(soa, tour);
+        }));
+
+        string file = "bench_TSP_n=" + to_string(n) + ".txt";
+        {
+            ofstream out(file);
+            for (int i = 0; i < n; ++i) out << i + 1 << " " << cities[i].x << " " << cities[i].y << "\n";
+        }
+        results.push_back(run_bench("read_city" + tag, "cities/s", n, warmup, reps, [&] {
+            vector<city> loaded;
+            read_city(file, loaded, false);
+            sink = sink + loaded.size();
+        }));
+        results.push_back(run_bench("read_city_cache" + tag, "cities/s", n, warmup, reps, [&] {
+            vector<city> loaded;
+            read_city(file, loaded);
+            sink = sink + loaded.size();
+        }));
+        remove(file.c_str());
+        remove((file + ".bin").c_str());
+
+        // 每種鄰域各跑一次，吞吐量為每秒評估次數，另外記下最後的路徑長度
+        AnnealOptions opt;
+        opt.verbose = false;
+        for (string name : {"swap", "2opt", "oropt", "mix"}) {
+            opt.nb = parse_neighborhood(name);
+            long long evals = 0;
+            double length = cal_length(cities, simul_anneal(cities, n, opt, &evals));
+            results.push_back(run_bench("simul_anneal_" + name + tag, "evals/s", evals, warmup, reps, [&] {
+                sink = sink + simul_anneal(cities, n, opt).size();
+            }));
+            results.back().tour_length = length;
+            cout << "  tour length: " << length << endl;
+        }
+
+        // 大型實例的設定 (二層雙向串列 + 貪婪初始路徑)，小的 n 上也跑，方便和陣列版比較
+        {
+            AnnealOptions large = opt;
+            large.nb = MIX, large.tour = "linked", large.init = "greedy";
+            long long evals = 0;
+            double length = cal_length(cities, simul_anneal(cities, n, large, &evals));
+            results.push_back(run_bench("simul_anneal_linked_greedy" + tag, "evals/s", evals, warmup, reps, [&] {
+                sink = sink + simul_anneal(cities, n, large).size();
+            }));
+            results.back().tour_length = length;
+            cout << "  tour length: " << length << endl;
+        }
+
+        // 從隨機路徑做到局部最佳 (2-opt + Or-opt + Or-3opt)
+        double polished = 0;
+        results.push_back(run_bench("polish_lk" + tag, "cities/s", n, warmup, reps, [&] {
+            vector<int> t = tour;
+            polished = polish(cities, t, "lk", 8, "auto").after;
+        }));
+        results.back().tour_length = polished;
+        cout << "  tour length: " << polished << endl;
+
+        // 每個核心一條鏈的 parallel tempering
+        int R = max(1u, thread::hardware_concurrency());
+        long long evals = 0;
+        opt.nb = MIX;
+        double length = cal_length(cities, parallel_tempering(cities, n, R, opt, &evals));
+        results.push_back(run_bench("parallel_tempering_R=" + to_string(R) + tag, "evals/s", evals, warmup, reps, [&] {
+            sink = sink + parallel_tempering(cities, n, R, opt).size();
+        }));
+        results.back().tour_length = length;
+        cout << "  tour length: " << length << endl;
+    }
+    return results;
+}
+
+int main(int argc, char *argv[]) {
+    bool bench = false;                      // 跑基準測試而不是求解
+    vector<int> bench_sizes = {50, 100, 200};
+    int bench_warmup = 2, bench_reps = 10;
+    string bench_out = "bench_simulated_annealing.json";  // .json 或 .csv
+    unsigned seed = time(0);                 // --seed=N 可重現同一次的結果
+    string move = "mix";                     // 鄰域：swap、2opt、oropt 或 mix
+    AnnealOptions opt;
+    int replicas = 0;                        // > 0 時改用 parallel tempering，每條鏈一個執行緒
+    vector<int> dims = {50, 100, 200, 500, 1000};  // 要跑的 TSP_Dim=N.txt
+    vector<string> inputs;                   // --input=檔案 (可重複，可為 TSPLIB)，指定時取代 dims
+    bool use_cache = true;                   // 讀寫 .bin 二進位座標快取
+    string polish_level = "none";            // 退火後的局部最佳化：none、local (2-opt + Or-opt) 或 lk (再加上 Or-3opt)
+    string telemetry = "stdout";             // 過程輸出：off、stdout、stderr，或 .csv / .jsonl 檔
+    long long telemetry_every = 1000;        // 每幾次評估取樣一次，0 為關閉
+    int telemetry_interval = 100;            // 背景執行緒寫出的間隔 (毫秒)
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--bench") bench = true;
+        else if (arg.rfind("--bench-sizes=", 0) == 0) bench_sizes = parse_list(arg.substr(14));
+        else if (arg.rfind("--bench-warmup=", 0) == 0) bench_warmup = max(0, stoi(arg.substr(15)));
+        else if (arg.rfind("--bench-reps=", 0) == 0) bench_reps = max(1, stoi(arg.substr(13)));
+        else if (arg.rfind("--bench-out=", 0) == 0) bench_out = arg.substr(12);
+        else if (arg.rfind("--seed=", 0) == 0) seed = stoul(arg.substr(7));
+        else if (arg.rfind("--move=", 0) == 0) move = arg.substr(7);
+        else if (arg.rfind("--knn=", 0) == 0) opt.knn = max(1, stoi(arg.substr(6)));
+        else if (arg.rfind("--dist=", 0) == 0) opt.dist = arg.substr(7);
+        else if (arg.rfind("--schedule=", 0) == 0) opt.schedule = arg.substr(11);
+        else if (arg.rfind("--accept=", 0) == 0) opt.accept = stod(arg.substr(9));
+        else if (arg.rfind("--t-end-ratio=", 0) == 0) opt.t_end_ratio = stod(arg.substr(14));
+        else if (arg.rfind("--stall=", 0) == 0) opt.stall = stoi(arg.substr(8));
+        else if (arg.rfind("--reheats=", 0) == 0) opt.reheats = max(0, stoi(arg.substr(10)));
+        else if (arg.rfind("--replicas=", 0) == 0) replicas = max(0, stoi(arg.substr(11)));
+        else if (arg.rfind("--polish=", 0) == 0) polish_level = arg.substr(9);
+        else if (arg.rfind("--tour=", 0) == 0) opt.tour = arg.substr(7);
+        else if (arg.rfind("--init=", 0) == 0) opt.init = arg.substr(7);
+        else if (arg.rfind("--dims=", 0) == 0) dims = parse_list(arg.substr(7));
+        else if (arg.rfind("--input=", 0) == 0) inputs.push_back(arg.substr(8));
+        else if (arg == "--no-cache") use_cache = false;
+        else if (arg.rfind("--telemetry=", 0) == 0) telemetry = arg.substr(12);
+        else if (arg.rfind("--telemetry-every=", 0) == 0) telemetry_every = max(0LL, stoll(arg.substr(18)));
+        else if (arg.rfind("--telemetry-interval=", 0) == 0) telemetry_interval = stoi(arg.substr(21));
+    }
+    if (move != "swap" && move != "2opt" && move != "oropt" && move != "mix") {
+        cerr << "Unknown --move=" << move << " (expected swap, 2opt, oropt or mix)" << endl;
+        return 1;
+    }
+    if (opt.dist != "auto" && opt.dist != "matrix" && opt.dist != "cache" && opt.dist != "exact") {
+        cerr << "Unknown --dist=" << opt.dist << " (expected auto, matrix, cache or exact)" << endl;
+        return 1;
+    }
+    if (opt.schedule != "adaptive" && opt.schedule != "geometric" && opt.schedule != "lundy" && opt.schedule != "legacy") {
+        cerr << "Unknown --schedule=" << opt.schedule << " (expected adaptive, geometric, lundy or legacy)" << endl;
+        return 1;
+    }
+    if (polish_level != "none" && polish_level != "local" && polish_level != "lk") {
+        cerr << "Unknown --polish=" << polish_level << " (expected none, local or lk)" << endl;
+        return 1;
+    }
+    if (opt.tour != "auto" && opt.tour != "array" && opt.tour != "linked") {
+        cerr << "Unknown --tour=" << opt.tour << " (expected auto, array or linked)" << endl;
+        return 1;
+    }
+    if (opt.init != "auto" && opt.init != "random" && opt.init != "sfc" && opt.init != "greedy") {
+        cerr << "Unknown --init=" << opt.init << " (expected auto, random, sfc or greedy)" << endl;
+        return 1;
+    }
+    if (bench) {
+        save_bench(bench_out, "simulated_annealing", run_benchmarks(bench_sizes, bench_warmup, bench_reps));
+        return 0;
+    }
+
+    opt.nb = parse_neighborhood(move);
+    optional<Telemetry> tel;
+    if (telemetry != "off" && telemetry_every > 0) opt.telemetry = &tel.emplace(telemetry, telemetry_every, telemetry_interval);
+    cout << "Seed: " << seed << ", neighborhood: " << move << ", schedule: " << opt.schedule << endl;
 
-    //數字之間沒關聯，所以直接創一個vector儲存我要跑的維度
-    vector<int> dims = {50, 100, 200, 500, 1000};
-    
-    for (int dim : dims) {
-        string inputFile = "TSP_Dim=" + to_string(dim) + ".txt";
-        string outputFile = "output_Dim=" + to_string(dim) + ".txt";
+    // 沒有指定 --input 時跑 TSP_Dim=N.txt，輸出到 output_Dim=N.txt；其他檔案輸出到 output_<檔名去掉副檔名>.txt
+    if (inputs.empty()) {
+        for (int dim : dims) inputs.push_back("TSP_Dim=" + to_string(dim) + ".txt");
+    }
+    for (const string &inputFile : inputs) {
+        string base = inputFile.substr(inputFile.find_last_of('/') + 1);
+        base = base.substr(0, base.rfind('.'));
+        string outputFile = base.rfind("TSP_Dim=", 0) == 0 ? "output_" + base.substr(4) + ".txt" : "output_" + base + ".txt";
 
         vector<city> cities;
-        read_city(inputFile, cities);
+        opt.metric = read_city(inputFile, cities, use_cache);
+        int dim = cities.size();
 
         auto start = chrono::high_resolution_clock::now();      //計時開始
 
         cout << "Dimension = " << dim << "   start..." << endl;
 
-        vector<int> result = simul_anneal(cities);
+        long long evals = 0;
+        vector<int> result = replicas > 0
+            ? parallel_tempering(cities, seed, replicas, opt, &evals)
+            : simul_anneal(cities, seed, opt, &evals);
+        if (tel) tel->flush();
+
+        if (polish_level != "none") {
+            PolishResult pr = polish(cities, result, polish_level, opt.knn, opt.dist, opt.metric);
+            cout << "Polish (" << polish_level << "): " << pr.before << " -> " << pr.after << " ("
+                 << (pr.before > 0 ? 100 * (pr.before - pr.after) / pr.before : 0) << "% shorter, "
+                 << pr.moves << " moves) in " << pr.seconds << " sec" << endl;
+        }
 
         auto end = chrono::high_resolution_clock::now();        //計時結束
         chrono::duration<double> elapsed = end - start;
@@ -136,7 +1934,8 @@ int main() {
 
         cout << "Dimension_" << dim << " done. "<< endl
              << "Execution time: " << elapsed.count() << " sec"<< endl 
-             << "Best tour length: " << cal_length(cities, result) << endl
+             << "Evals per second: " << evals / elapsed.count() << endl
+             << "Best tour length: " << cal_length(cities, result, opt.metric) << endl
              << endl << endl;
     }
     return 0;